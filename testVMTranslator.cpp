@@ -2,1333 +2,7353 @@
 #include <fstream>
 #include <iostream>
 #include <set>
+#include <map>
 #include <dirent.h>
+#include <sys/stat.h>
+#ifdef _WIN32
 #include <windows.h>
+#include <direct.h>
+#include <io.h>
+#include <fcntl.h>
+#include <psapi.h>
+#endif
 #include <iomanip>
 #include <stack>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <string_view>
+#include <cstring>
+#include <climits>
+#include <charconv>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <type_traits>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cctype>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#endif
+#if defined(VMT_USE_IO_URING) && defined(__has_include)
+#if __has_include(<liburing.h>)
+#include <liburing.h>
+#define VMT_HAS_IO_URING
+#endif
+#endif
 using namespace std;
 
+#ifdef COUNT_ALLOCATIONS
 /*
-	Functionality: Contains all the methods neccessary for parsing a document in JACK VM code
+	Functionality: Number of heap allocations made by the current thread so far. It is only kept
+	               when the program is compiled with COUNT_ALLOCATIONS defined, which replaces the
+				   global operator new and new[] so every allocation increments it. Each thread
+				   has its own count, so a parser only sees the allocations of its own thread,
+				   even while other files are parsed on other threads.
 */
-class Parser
+thread_local size_t allocationCount = 0;
+
+// Never inlined, so the compiler does not see memory from malloc released by operator delete
+#if defined(__GNUC__)
+#define NOT_INLINED __attribute__((noinline))
+#else
+#define NOT_INLINED __declspec(noinline)
+#endif
+NOT_INLINED void* operator new(size_t size)
+{
+	allocationCount++;
+	void* memory = malloc(size == 0 ? 1 : size);
+	if (memory == nullptr) throw bad_alloc();
+	return memory;
+}
+NOT_INLINED void* operator new[](size_t size) { return operator new(size); }
+NOT_INLINED void operator delete(void* memory) noexcept { free(memory); }
+NOT_INLINED void operator delete(void* memory, size_t) noexcept { free(memory); }
+NOT_INLINED void operator delete[](void* memory) noexcept { free(memory); }
+NOT_INLINED void operator delete[](void* memory, size_t) noexcept { free(memory); }
+#undef NOT_INLINED
+#endif
+
+/*
+	Functionality: Every command of the JACK VM language. The parser decodes each line into one
+	               of these so that the rest of the translator never compares strings again.
+*/
+enum Opcode : unsigned char
+{
+	OP_NONE,
+	OP_ADD,
+	OP_SUB,
+	OP_NEG,
+	OP_EQ,
+	OP_GT,
+	OP_LT,
+	OP_AND,
+	OP_OR,
+	OP_NOT,
+	OP_PUSH,
+	OP_POP,
+	OP_LABEL,
+	OP_GOTO,
+	OP_IF_GOTO,
+	OP_FUNCTION,
+	OP_CALL,
+	OP_RETURN
+};
+/*
+	Functionality: The command types of the JACK VM language. C_NONE is used for lines that do
+	               not contain an instruction.
+*/
+enum CommandType : unsigned char
+{
+	C_NONE,
+	C_ARITHMETIC,
+	C_PUSH,
+	C_POP,
+	C_LABEL,
+	C_GOTO,
+	C_IF,
+	C_FUNCTION,
+	C_RETURN,
+	C_CALL
+};
+/*
+	Functionality: The eight virtual memory segments that push and pop can access.
+*/
+enum Segment : unsigned char
+{
+	SEG_NONE,
+	SEG_ARGUMENT,
+	SEG_LOCAL,
+	SEG_STATIC,
+	SEG_CONSTANT,
+	SEG_THIS,
+	SEG_THAT,
+	SEG_POINTER,
+	SEG_TEMP
+};
+/*
+	Functionality: One decoded JACK VM instruction. Labels and function names are not stored as
+	               text but as the id the symbol table assigned to them, so every instruction has
+				   the same size and a whole program fits in one contiguous array.
+
+	Fields:        opcode  - The command
+	               segment - The segment of a push/pop, SEG_NONE otherwise
+				   index   - The index of a push/pop or the nLocals of a function. -1 if the
+				             command has none.
+				   symbol  - The interned label or function name, -1 if the command has none.
+*/
+struct Instruction
+{
+	Opcode opcode;
+	Segment segment;
+	int index;
+	int symbol;
+};
+static_assert(sizeof(Instruction) == 12, "Instructions are meant to stay small and fixed-size");
+/*
+	Functionality: Assigns a small integer id to every distinct label and function name seen in
+	               the program, so each name is stored once no matter how often it is used.
+
+	               The names are kept in fixed-size chunks reached through a directory that never
+				   grows, so a stored name never moves. This lets one thread keep interning names
+				   while another reads the names of the ids it has already been handed.
+*/
+class SymbolTable
+{
+private:
+	static const int namesPerChunk = 4096;
+	static const int maxChunks = 1024;
+	unique_ptr<string[]> chunks[maxChunks];
+	int nameCount;
+	unordered_map<string_view, int> ids;  // views into the chunks
+
+public:
+	SymbolTable() : nameCount(0) {}
+	/*
+		Functionality: Returns the id of the received name, adding it to the table if it is the
+		               first time it is seen.
+	*/
+	int intern(string_view name);
+	const string& nameOf(int id) const { return chunks[id / namesPerChunk][id % namesPerChunk]; }
+	int size() const { return nameCount; }
+};
+/*
+	Functionality: The range of instructions that came from a single VM file. The file name is
+	               needed by the code writer to name the static variables.
+*/
+struct Module
+{
+	string fileName;
+	size_t firstInstruction;
+	size_t instructionCount;
+};
+/*
+	Functionality: Holds every instruction of every translated file in one arena, together with
+	               the symbol table they refer to and the boundaries of each file.
+*/
+class Program
+{
+private:
+	vector<Instruction> instructions;
+	vector<Module> modules;
+	SymbolTable symbols;
+
+public:
+	vector<Instruction>& getInstructions() { return instructions; }
+	const vector<Instruction>& getInstructions() const { return instructions; }
+	vector<Module>& getModules() { return modules; }
+	const vector<Module>& getModules() const { return modules; }
+	SymbolTable& getSymbols() { return symbols; }
+	const SymbolTable& getSymbols() const { return symbols; }
+};
+/*
+	Functionality: Returns the command type an opcode belongs to.
+*/
+CommandType commandTypeOf(Opcode);
+/*
+	Functionality: The binary form of a VM file (.vmb), which is loaded without lexing anything.
+
+	               The file starts with the 4 magic bytes and the format version, followed by a
+				   string table with every label and function name the file uses. Then comes the
+				   instruction count and the instructions. Each instruction is its opcode byte
+				   followed by what its command type carries:
+
+				   push, pop       - segment byte, index
+				   label, goto, if - name
+				   function, call  - name, index
+
+				   Numbers are unsigned LEB128 varints. Indexes are stored plus one and names as
+				   their position in the string table plus one, so -1 (none) fits. The opcode and
+				   segment bytes are the values of Opcode and Segment.
+*/
+const char bytecodeMagic[4] = { 0x7f, 'V', 'M', 'B' };
+const unsigned bytecodeVersion = 1;
+static_assert(OP_RETURN == 17 && SEG_TEMP == 8, "Changing the opcodes or segments changes the bytecode format");
+/*
+	Functionality: Appends an unsigned LEB128 varint to the received bytes.
+*/
+inline void writeVarint(string& bytes, uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		bytes += (char)(value | 0x80);
+		value >>= 7;
+	}
+	bytes += (char)value;
+}
+/*
+	Functionality: Reads an unsigned LEB128 varint from the received bytes at pos and moves pos
+	               past it. Returns false if the bytes end first or the varint is too long.
+*/
+inline bool readVarint(string_view bytes, size_t& pos, uint64_t& value)
+{
+	value = 0;
+	for (int shift = 0; shift < 64 && pos < bytes.size(); shift += 7)
+	{
+		unsigned char byte = (unsigned char)bytes[pos++];
+		value |= (uint64_t)(byte & 0x7f) << shift;
+		if ((byte & 0x80) == 0) return true;
+	}
+	return false;
+}
+/*
+	Functionality: Returns true if the received file contents are in the binary form.
+*/
+inline bool isBytecode(string_view contents)
+{
+	return contents.size() >= sizeof(bytecodeMagic) &&
+		memcmp(contents.data(), bytecodeMagic, sizeof(bytecodeMagic)) == 0;
+}
+/*
+	Functionality: A bounded queue between exactly one producer thread and one consumer thread.
+	               It needs no locks: the producer only ever moves the tail and the consumer only
+				   ever moves the head. Items are filled and read in place in the ring's slots.
+
+				   Each side counts how many times it had to wait for the other (a full ring for
+				   the producer, an empty ring for the consumer).
+*/
+template <typename Item, size_t Capacity>
+class SPSCRing
 {
 private:
-	ifstream vmCode;
-	string currentInstruction;
-	string currentCommand;
-	string currentCommandType;
-	string currentModifier;
-	int currentIndex;
+	Item slots[Capacity];
+	alignas(64) atomic<size_t> head;    // next slot to consume
+	alignas(64) atomic<size_t> tail;    // next slot to produce
+	alignas(64) size_t producerStalls;
+	alignas(64) size_t consumerStalls;
+
+public:
+	SPSCRing() : head(0), tail(0), producerStalls(0), consumerStalls(0) {}
 
 	/*
-		Functionality: Determines if the current line being traversed contains an instruction. If
-					   it does, returns true.
+		Functionality: Producer side. Waits until there is a free slot and returns it, to be
+		               filled in place and then published.
 	*/
-	bool HasInstruction(string);
+	Item& waitForFreeSlot()
+	{
+		size_t currentTail = tail.load(memory_order_relaxed);
+		while (currentTail - head.load(memory_order_acquire) == Capacity)
+		{
+			producerStalls++;
+			this_thread::yield();
+		}
+		return slots[currentTail % Capacity];
+	}
 	/*
-		Functionality: Receives a string, cl, and removes all the spaces at the beginning in place.
+		Functionality: Producer side. Hands the slot returned by waitForFreeSlot() to the consumer.
 	*/
-	void removeWhitespaceFrom(string&);
+	void publish() { tail.store(tail.load(memory_order_relaxed) + 1, memory_order_release); }
 	/*
-		Functionality: Receives the current line being traversed, cL, and extracts and returns the
-					   command in a string.
+		Functionality: Consumer side. Waits until a slot has been published and returns it.
 	*/
-	string extractCommandFrom(string);
+	Item& waitForFilledSlot()
+	{
+		size_t currentHead = head.load(memory_order_relaxed);
+		while (tail.load(memory_order_acquire) == currentHead)
+		{
+			consumerStalls++;
+			this_thread::yield();
+		}
+		return slots[currentHead % Capacity];
+	}
 	/*
-		Functionality: Receives a string that contains the current line being traversed, cL, and
-					   extracts and returns the current command type from it. This function assumes
-					   that whitespaces have been removed from the current line and that it
-					   contains an instruction in JACK VM.
+		Functionality: Consumer side. Gives the slot returned by waitForFilledSlot() back to the
+		               producer.
+	*/
+	void release() { head.store(head.load(memory_order_relaxed) + 1, memory_order_release); }
+
+	size_t getProducerStalls() const { return producerStalls; }
+	size_t getConsumerStalls() const { return consumerStalls; }
+};
+/*
+	Functionality: A group of decoded instructions handed from the parser thread to the code
+	               writer thread in one go, so the threads synchronize once per batch instead of
+				   once per instruction. The last batch of a file is marked.
+*/
+struct InstructionBatch
+{
+	static const int capacity = 256;
+	Instruction instructions[capacity];
+	int count;
+	bool isLast;
+};
+
+/*
+	Functionality: A word of the JACK VM language: either a command, which has an opcode, or the
+	               name of a segment, which has a segment.
+*/
+struct Keyword
+{
+	string_view text;
+	Opcode opcode;
+	Segment segment;
+};
+constexpr Keyword keywords[] =
+{
+	{ "add", OP_ADD, SEG_NONE },
+	{ "sub", OP_SUB, SEG_NONE },
+	{ "neg", OP_NEG, SEG_NONE },
+	{ "eq", OP_EQ, SEG_NONE },
+	{ "gt", OP_GT, SEG_NONE },
+	{ "lt", OP_LT, SEG_NONE },
+	{ "and", OP_AND, SEG_NONE },
+	{ "or", OP_OR, SEG_NONE },
+	{ "not", OP_NOT, SEG_NONE },
+	{ "push", OP_PUSH, SEG_NONE },
+	{ "pop", OP_POP, SEG_NONE },
+	{ "label", OP_LABEL, SEG_NONE },
+	{ "goto", OP_GOTO, SEG_NONE },
+	{ "if-goto", OP_IF_GOTO, SEG_NONE },
+	{ "function", OP_FUNCTION, SEG_NONE },
+	{ "call", OP_CALL, SEG_NONE },
+	{ "return", OP_RETURN, SEG_NONE },
+	{ "argument", OP_NONE, SEG_ARGUMENT },
+	{ "local", OP_NONE, SEG_LOCAL },
+	{ "static", OP_NONE, SEG_STATIC },
+	{ "constant", OP_NONE, SEG_CONSTANT },
+	{ "this", OP_NONE, SEG_THIS },
+	{ "that", OP_NONE, SEG_THAT },
+	{ "pointer", OP_NONE, SEG_POINTER },
+	{ "temp", OP_NONE, SEG_TEMP }
+};
+/*
+	Functionality: Hashes a word of at least two characters into a slot of the keyword table.
+	               It mixes the length, the first two characters and the last one, which is
+				   enough to tell every keyword apart (e.g. "label" and "local" only differ in
+				   their second character).
+*/
+constexpr unsigned keywordHash(string_view word)
+{
+	return (unsigned)(word.size() + word[0] * 30 + word[1] + (word.back() << 3)) & 63;
+}
+/*
+	Functionality: The keywords placed in the slot their hash points to, built at compile time.
+*/
+struct KeywordTable
+{
+	Keyword slots[64];
+};
+constexpr KeywordTable buildKeywordTable()
+{
+	KeywordTable table = {};
+	for (const Keyword& keyword : keywords) table.slots[keywordHash(keyword.text)] = keyword;
+	return table;
+}
+constexpr KeywordTable keywordTable = buildKeywordTable();
+/*
+	Functionality: Returns true if no two keywords share a slot, so a lookup never needs more
+	               than one comparison.
+*/
+constexpr bool keywordTableIsPerfect()
+{
+	for (const Keyword& keyword : keywords)
+	{
+		if (keywordTable.slots[keywordHash(keyword.text)].text != keyword.text) return false;
+	}
+	return true;
+}
+static_assert(keywordTableIsPerfect(), "Two keywords share a slot, change keywordHash");
+/*
+	Functionality: Returns the keyword the received word is, or nullptr if it is not one. It costs
+	               one hash and one comparison whatever the word.
+*/
+inline const Keyword* findKeyword(string_view word)
+{
+	if (word.size() < 2) return nullptr;
+	const Keyword& slot = keywordTable.slots[keywordHash(word)];
+	bool wordIsKeyword = (slot.text == word);
+	if (wordIsKeyword) return &slot;
+	return nullptr;
+}
+/*
+	Functionality: How the HACK code reaches a segment.
 
+	               ACCESS_CONSTANT        - The index itself is the value
+				   ACCESS_THROUGH_POINTER - The segment starts where a pointer register points
+				   ACCESS_FIXED_REGISTER  - The segment lives in fixed registers (R3 or R5 on)
+				   ACCESS_STATIC          - Each index is a variable named after the file
+*/
+enum SegmentAccess : unsigned char
+{
+	ACCESS_CONSTANT,
+	ACCESS_THROUGH_POINTER,
+	ACCESS_FIXED_REGISTER,
+	ACCESS_STATIC
+};
+/*
+	Functionality: What the code writer needs to know about a segment: its name as printed in the
+	               comments, how it is accessed, and its base pointer or first register.
+*/
+struct SegmentInfo
+{
+	const char* upperCaseName;
+	SegmentAccess access;
+	const char* baseLabel;
+	int firstRegister;
+};
+// Indexed by Segment. SEG_NONE is treated as static, like any unknown segment.
+constexpr SegmentInfo segmentTable[] =
+{
+	{ "STATIC", ACCESS_STATIC, "", 0 },             // SEG_NONE
+	{ "ARGUMENT", ACCESS_THROUGH_POINTER, "ARG", 0 },
+	{ "LOCAL", ACCESS_THROUGH_POINTER, "LCL", 0 },
+	{ "STATIC", ACCESS_STATIC, "", 0 },
+	{ "CONSTANT", ACCESS_CONSTANT, "", 0 },
+	{ "THIS", ACCESS_THROUGH_POINTER, "THIS", 0 },
+	{ "THAT", ACCESS_THROUGH_POINTER, "THAT", 0 },
+	{ "POINTER", ACCESS_FIXED_REGISTER, "", 3 },
+	{ "TEMP", ACCESS_FIXED_REGISTER, "", 5 }
+};
+static_assert(sizeof(segmentTable) / sizeof(segmentTable[0]) == SEG_TEMP + 1,
+	"segmentTable needs one entry per Segment");
 
+/*
+	Functionality: A VM file found in the folder being translated.
+
+	Fields:        path - Where the file is, starting with the folder that was searched
+	               name - The name of the file without its folders, used for its static variables
+				   size - Its size in bytes, so the largest files can be started first
+*/
+struct SourceFile
+{
+	string path;
+	string name;
+	size_t size;
+};
+/*
+	Functionality: The whole contents of one input file, read ahead of parsing.
+
+	Fields:        index    - Position of the file in the list of files that was read
+	               contents - The bytes of the file. Empty if it could not be read.
+*/
+struct IngestedFile
+{
+	size_t index;
+	string contents;
+};
+/*
+	Functionality: What tells if a file has changed without reading it: its size and the time it
+	               was last written, in nanoseconds where the file system keeps them.
+*/
+struct FileSignature
+{
+	long long size;
+	long long modificationTime;
+
+	bool operator==(const FileSignature& other) const
+	{
+		return size == other.size && modificationTime == other.modificationTime;
+	}
+};
+/*
+	Functionality: Waits for something to change in a folder and in all the folders inside it.
+	               Uses inotify where there is one, watching every folder of the tree and the
+				   folders created in it later. Elsewhere, or if inotify fails, it only waits a
+				   little, and the caller looks for changes itself.
+*/
+class FolderWatcher
+{
+private:
+	int inotifyDescriptor;                       // -1 when polling
+	unordered_map<int, string> watchedFolders;   // by watch descriptor
 
-		Return types:
-					   C_ARITHMETIC - All arithmetic commands
-					   C_PUSH
-					   C_POP
-					   C_LABEL
-					   C_GOTO
-					   C_IF
-					   C_FUNCTION
-					   C_RETURN
-					   C_CALL
-	*/
-	string extractCommandTypeFrom(string);
 	/*
-		Functionality: Receives the command type of the current instruction, cT, and returns true
-					   or false depending upon the syntax of the command type.
+		Functionality: Watches the folder and every folder inside it, skipping the same folders
+		               as discoverVMFiles.
+	*/
+	void watchTree(const string& folder);
 
+public:
+	FolderWatcher(const string& folder);
+	~FolderWatcher();
+	FolderWatcher(const FolderWatcher&) = delete;
+	FolderWatcher& operator=(const FolderWatcher&) = delete;
+
+	bool usesInotify() const { return inotifyDescriptor >= 0; }
+	/*
+		Functionality: Returns once a VM file may have changed, been added or been removed. With
+		               inotify, waits for the changes to stop for a moment first, since saving a
+					   file often takes more than one event.
 	*/
-	bool currentCommandHasModifier();
+	void waitForChange();
+};
+/*
+	Functionality: Random numbers that come out the same from the same seed on every platform
+	               (splitmix64), so a generated benchmark program can be made again anywhere.
+*/
+class SeededRandom
+{
+private:
+	uint64_t state;
+
+public:
+	explicit SeededRandom(uint64_t seed) : state(seed) {}
+
+	uint64_t next()
+	{
+		uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+		return z ^ (z >> 31);
+	}
 	/*
-		Functionality: Access the current command and extracts the modifier from it. It assumes the
-					   program has checked if the command contains a modifier.
+		Functionality: Returns a number from 0 to bound - 1.
 	*/
-	string extractModifier(string);
+	int below(int bound) { return (int)(next() % (uint64_t)bound); }
+};
+/*
+	Functionality: Hands the files read by one thread to the threads that parse them, in the
+	               order the reads complete. pop() waits until there is a file to hand out.
+*/
+class IngestedFileQueue
+{
+private:
+	mutex queueMutex;
+	condition_variable fileAvailable;
+	deque<IngestedFile> files;
+
+public:
+	void push(IngestedFile&& file);
+	IngestedFile pop();
+};
+/*
+	Functionality: Gives read-only access to the whole contents of a file without copying it.
+	               The file is mapped into memory once when the operating system allows it, and
+				   read into a buffer otherwise (empty files, pipes, failed mappings).
+*/
+class InputFile
+{
+private:
+	const char* data;
+	size_t length;
+	bool isMapped;
+	string fallbackBuffer;
+#ifdef _WIN32
+	HANDLE fileHandle;
+	HANDLE mappingHandle;
+#endif
+
 	/*
-		Functionality: Receives the current line, cL, and determines if there is an index to be
-					   extracted from it. It supposes the current line contains a valid instruct.
+		Functionality: Tries to map the received file. Returns false if it could not be mapped.
 	*/
-	bool currentInstructionHasIndex();
+	bool map(const string&);
 	/*
-		Functionality: Receives the current line, cL, and extracts the index from it. It assumes
-					   the current line has a valid instruction and contains an index.
+		Functionality: Reads the received file into the fallback buffer.
 	*/
-	int extractIndex(string);
+	void readIntoBuffer(const string&);
 
 public:
-	Parser(string fileName);
-	~Parser() { vmCode.close(); }
-
-	string getCurrentInstruction() { return currentInstruction; }
-	string getCurrentCommand() { return currentCommand; }
-	string getCurrentCommandType() { return currentCommandType; }
-	string getCurrentModifier() { return currentModifier; }
-	int getCurrentIndex() { return currentIndex; }
+	InputFile(const string& fileName);
+	/*
+		Functionality: Takes over the contents of a file that has already been read.
+	*/
+	InputFile(IngestedFile&& file);
+	~InputFile();
+	InputFile(const InputFile&) = delete;
+	InputFile& operator=(const InputFile&) = delete;
 
+	string_view contents() const { return string_view(data, length); }
+};
+/*
+	Functionality: The tokens of one line that holds an instruction, as offsets into the text the
+	               line was scanned from. Only the first three tokens are kept, which is all a
+				   JACK VM instruction has.
+*/
+struct ScannedLine
+{
+	static const int maxTokens = 3;
+	size_t tokenPos[maxTokens];
+	unsigned tokenLength[maxTokens];
+	int tokenCount;
+};
+/*
+	Functionality: Splits a text into lines and every line into tokens, dropping whitespace and
+	               comments. The text is classified 64 bytes at a time with SIMD compares, giving
+				   one bit mask for newlines, one for slashes and one for separators, and only
+				   the bits where something changes are visited. Lines without tokens are never
+				   handed out.
+
+	               Spaces, tabs and carriage returns separate tokens. A slash starts a comment
+				   that runs to the end of the line.
+*/
+class LineScanner
+{
+private:
+	string_view text;
+	size_t nextPos;                       // start of the next line to scan
+	size_t linesScanned;
 
 	/*
-		Functionality: Returns true if there are more commands in the input. False otherwise.
+		Functionality: Classifies the 64 bytes starting at block. Bit i of each mask is set when
+		               byte i is a newline, a slash or a separator (newlines and slashes included).
 	*/
-	bool hasMoreLines();
+	static void classifyBlock(const char* block, uint64_t& newlines, uint64_t& slashes,
+		uint64_t& separators);
+
+public:
+	LineScanner(string_view textToScan);
+
+	bool atEnd() const { return nextPos >= text.size(); }
+	size_t getLinesScanned() const { return linesScanned; }
+	string_view tokenOf(const ScannedLine& line, int token) const
+	{
+		return text.substr(line.tokenPos[token], line.tokenLength[token]);
+	}
+
 	/*
-		Functionality: Should only be called if hasMoreLines() returns true. It reads the
-					   current line and stores it, extracts the current command, command type,
-					   current segment (if applicable), and current index (if applicable), and
-					   stores all the information.
+		Functionality: Scans lines until maxLines lines with tokens have been appended to the
+		               received vector or the text ends. Returns how many were appended. The
+					   next call continues with the line after the last one appended.
 	*/
-	void advance();
+	size_t scanLines(vector<ScannedLine>&, size_t maxLines);
 };
 /*
-	This class contains all the methods necessary to translate an instruction from JACK VM code
-	to HACK assembly language and output the translation into an output file.
+	Functionality: Contains all the methods neccessary for parsing a document in JACK VM code
 */
-class CodeWriter
+class Parser
 {
 private:
-	string outputFileName;
-	string fileWOExtension;
-	ofstream assemblyCode;
-	int writtenInstructionsSoFar;
-	stack<string> functionTracker;
+	InputFile vmCode;
+	LineScanner scanner;
+	vector<ScannedLine> scannedLines;     // lines scanned but not decoded yet
+	size_t nextScannedLine;
+	SymbolTable& symbols;
+	Instruction currentInstruction;
+	size_t allocatingLines;               // only counted with COUNT_ALLOCATIONS
+	size_t allocationsWhileInterning;     // only counted with COUNT_ALLOCATIONS
+	size_t allocationsWhileScanning;      // by the last scan, charged to the next line decoded
+	static const size_t linesPerScan = 4096;
+	bool inputIsBytecode;
+	bool inputIsValid;                    // false once a binary file turns out to be broken
+	size_t nextBytecodePos;
+	vector<int> bytecodeSymbols;          // symbol id of every name in the string table
+	size_t bytecodeInstructionCount;      // as the header gives it
+	size_t bytecodeInstructionsRead;
+
+	enum BytecodeHeader
+	{
+		HEADER_NONE,                      // the file is text
+		HEADER_VALID,
+		HEADER_INVALID
+	};
+	/*
+		Functionality: If the file is in the binary form, reads its header and interns every name
+		               in its string table. Returns HEADER_NONE if the file is text, and
+					   HEADER_INVALID if the header can't be read.
+	*/
+	BytecodeHeader readBytecodeHeader();
+	/*
+		Functionality: Decodes the next instruction of a file in the binary form.
+	*/
+	void advanceThroughBytecode();
 
-public:
-	~CodeWriter();
 	/*
-		Functionality: Receives a string, c, that contains an arithmetic command in JACK VM
-					   language, and outputs the translation to HACK assembly to the output file.
+		Functionality: Receives the command of the current line and returns its opcode. Returns
+		               OP_NONE if the command is not part of the language.
 	*/
-	void writeArithmetic(string);
-	void writePushPop(string, string, int);
+	Opcode extractOpcodeFrom(string_view);
 	/*
-		What it does: Writes the needed preamble for every translated file. It sets up the stack
-		              pointer to 256, calls the sys.init() function of the operating system, and 
-					  writes the code for the all the comparisons in the program.
+		Functionality: Receives the name of a virtual memory segment and returns it as a Segment.
 	*/
-	void writeInit();
+	Segment extractSegmentFrom(string_view);
 	/*
-		What it does: It handles the initializing of variables and writing of the bootstrap code
-		              The functionality depends on the number files that have been translated when 
-					  it is called.
-
-	    Assumptions: 1. This is only called when the driver is dealing with a folder with
-			            multiple VM files.
-				     2. The file counter is never less than zero
+		Functionality: Receives the command type of the current instruction, cT, and returns true
+					   or false depending upon the syntax of the command type.
 
-	    Inputs:      1. A string containing the input file name
-			         2. An int that indicates how many files have been translated thus far.
 	*/
-	void initialize(string, int);
+	bool currentCommandHasModifier();
 	/*
-		What it does: Writes HACK assembly code that effects the "label" command.
-
-		Assumptions:  1. Will not be called if there is no label command.
-					  2. The label is error free
-					  3. The stack tracking the called functions is not empty
-					  4. The input refers to a label that has not been used before inside the
-					     current function.
-
-		Inputs:       1. A string, l, containing the label to be output to the assembly file.
+		Functionality: Receives the current line, cL, and determines if there is an index to be
+					   extracted from it. It supposes the current line contains a valid instruct.
 	*/
-	void writeLabel(string);
+	bool currentInstructionHasIndex();
 	/*
-		What it does: Writes HACK assembly code that effects the JACK VM "goto" command.
-
-		Assumptions:
-		1. The label is always within some function.
-		2. The passed label contains no mistakes.
-		3. The compiler takes care of returning to the correct instruction after the jump.
-
-		Inputs:
-		1. A string, l, containing the label to which to jump.
+		Functionality: Receives the index token of the current line and converts it to an int.
+	*/
+	int extractIndex(string_view);
 
+public:
+	/*
+		Functionality: Opens the received file for parsing. Labels and function names found in it
+		               are interned in the received symbol table.
 	*/
-	void writeGOTO(string);
+	Parser(string fileName, SymbolTable& symbolTable);
 	/*
-		What it does: Writes HACK assembly code that effects the JACK VM if-goto command.
-
-		Assumptions:
+		Functionality: Parses a file that has already been read.
+	*/
+	Parser(IngestedFile&& file, SymbolTable& symbolTable);
+
+	const Instruction& getCurrentInstruction() { return currentInstruction; }
+	Opcode getCurrentOpcode() { return currentInstruction.opcode; }
+	CommandType getCurrentCommandType() { return commandTypeOf(currentInstruction.opcode); }
+	Segment getCurrentSegment() { return currentInstruction.segment; }
+	int getCurrentSymbol() { return currentInstruction.symbol; }
+	int getCurrentIndex() { return currentInstruction.index; }
+	size_t getLinesParsed() { return inputIsBytecode ? bytecodeInstructionsRead : scanner.getLinesScanned(); }
+	/*
+		Functionality: Returns how many lines made heap allocations while they were scanned or
+		               decoded, not counting the ones made to intern a new name. Always 0 unless
+					   the program is compiled with COUNT_ALLOCATIONS.
+	*/
+	size_t getAllocatingLines() { return allocatingLines; }
+	/*
+		Functionality: Returns how many heap allocations the symbol table made to intern the
+		               names seen for the first time. Always 0 unless the program is compiled
+					   with COUNT_ALLOCATIONS.
+	*/
+	size_t getAllocationsWhileInterning() { return allocationsWhileInterning; }
+	/*
+		Functionality: Returns false if the file is in the binary form but its header can't be
+		               read, an instruction in it can't be decoded, or it ends before the number
+					   of instructions its header gives. Text files are always valid.
+	*/
+	bool isValid() { return inputIsValid; }
+
+	/*
+		Functionality: Returns true if there are more commands in the input. False otherwise.
+	*/
+	bool hasMoreLines();
+	/*
+		Functionality: Should only be called if hasMoreLines() returns true. It takes the
+					   next scanned line, decodes its opcode, segment (if applicable), symbol (if
+					   applicable), and index (if applicable), and stores the instruction.
+	*/
+	void advance();
+	/*
+		Functionality: Parses every remaining line of the file and appends the instructions found
+		               to the received vector.
+	*/
+	void parseAllInto(vector<Instruction>&);
+};
+/*
+	Functionality: Where buffered assembly code is finally written. Implementations only receive
+	               large blocks of text, so a virtual call per block costs nothing.
+*/
+class OutputSink
+{
+public:
+	virtual ~OutputSink() {}
+	virtual void write(const char* data, size_t length) = 0;
+};
+/*
+	Functionality: Writes to a file without any buffering of its own, so every block received from
+	               an AssemblyBuffer becomes a single write to the operating system.
+*/
+class FileSink : public OutputSink
+{
+private:
+	FILE* file;
+	bool writeFailed;
+
+public:
+	FileSink() : file(nullptr), writeFailed(false) {}
+	~FileSink() { close(); }
+	FileSink(const FileSink&) = delete;
+	FileSink& operator=(const FileSink&) = delete;
+
+	/*
+		Functionality: Opens (and truncates) the received file. Returns false if it can't be opened.
+	*/
+	bool open(const string& fileName);
+	/*
+		Functionality: Closes the file. Returns false if the file could not be opened, or if a
+		               write or the close itself failed, so the file does not hold all the code.
+	*/
+	bool close();
+	void write(const char* data, size_t length) override;
+};
+/*
+	Functionality: Writes to the standard output, so the code can be piped into another program.
+	               Every block is flushed as soon as it is written, so whoever reads it gets the
+				   code as it is translated.
+*/
+class StandardOutputSink : public OutputSink
+{
+public:
+	StandardOutputSink();
+	void write(const char* data, size_t length) override;
+};
+/*
+	Functionality: Accumulates assembly code in a growable in-memory buffer and hands it to its
+	               sink in one block when the buffer reaches its high-water mark, or when flushed.
+				   Without a sink it simply keeps growing, so it can hold a whole translation in
+				   memory.
+*/
+class AssemblyBuffer
+{
+private:
+	string buffer;
+	OutputSink* sink;
+	size_t highWaterMark;
+	size_t bytesWritten;
+	int flushCount;
+
+public:
+	AssemblyBuffer(size_t highWaterMarkInBytes = 1 << 20);
+	~AssemblyBuffer() { flush(); }
+
+	void setSink(OutputSink* outputSink) { sink = outputSink; }
+	/*
+		Functionality: Copies the received text to the end of the buffer. Flushes if the buffer
+		               reaches its high-water mark.
+	*/
+	void append(const char* text, size_t length);
+	/*
+		Functionality: Hands everything in the buffer to the sink and empties it. Does nothing
+		               if there is no sink or the buffer is empty.
+	*/
+	void flush();
+
+	AssemblyBuffer& operator<<(string_view text) { append(text.data(), text.size()); return *this; }
+	AssemblyBuffer& operator<<(const char* text) { return *this << string_view(text); }
+	AssemblyBuffer& operator<<(const string& text) { return *this << string_view(text); }
+	AssemblyBuffer& operator<<(char character) { append(&character, 1); return *this; }
+	AssemblyBuffer& operator<<(int number);
+
+	string_view contents() const { return buffer; }
+	/*
+		Functionality: Moves the buffered text out of the buffer, leaving it empty.
+	*/
+	string takeContents() { string contents = move(buffer); buffer.clear(); return contents; }
+	/*
+		Functionality: Empties the buffer without handing its contents to the sink.
+	*/
+	void clear() { buffer.clear(); }
+	size_t getBytesWritten() const { return bytesWritten; }
+	int getFlushCount() const { return flushCount; }
+};
+/*
+	Functionality: A place in the code, known by a number instead of by its ROM address. Snippets
+	               refer to labels like to any other operand, and the writer works out their
+				   addresses once they are placed, so no snippet needs to know how many ROM words
+				   any code takes. Code translated on its own also records where each address is
+				   written, so it can later be moved to another address.
+*/
+struct CodeLabel
+{
+	int id;
+};
+const int hackRomWords = 32768;
+/*
+	Functionality: How long the emulator runs a program that does not halt, in cycles.
+*/
+const uint64_t emulatorCycleLimit = 2000000000;
+/*
+	Functionality: How long the interpreter runs a program that does not halt, in VM instructions.
+*/
+const uint64_t interpreterInstructionLimit = 2000000000;
+/*
+	Functionality: The symbols every HACK program has, and their values.
+*/
+struct PredefinedSymbol
+{
+	const char* name;
+	int value;
+};
+constexpr PredefinedSymbol predefinedSymbols[] = {
+	{ "SP", 0 }, { "LCL", 1 }, { "ARG", 2 }, { "THIS", 3 }, { "THAT", 4 },
+	{ "R0", 0 }, { "R1", 1 }, { "R2", 2 }, { "R3", 3 }, { "R4", 4 }, { "R5", 5 }, { "R6", 6 },
+	{ "R7", 7 }, { "R8", 8 }, { "R9", 9 }, { "R10", 10 }, { "R11", 11 }, { "R12", 12 },
+	{ "R13", 13 }, { "R14", 14 }, { "R15", 15 }, { "SCREEN", 16384 }, { "KBD", 24576 } };
+/*
+	Functionality: The a bit and the six c bits of every computation a C-instruction can make. The
+	               operands of +, & and | can be written in either order.
+*/
+struct Computation
+{
+	const char* mnemonic;
+	int bits;
+};
+constexpr Computation computations[] = {
+	{ "0", 0b0101010 }, { "1", 0b0111111 }, { "-1", 0b0111010 }, { "D", 0b0001100 },
+	{ "A", 0b0110000 }, { "!D", 0b0001101 }, { "!A", 0b0110001 }, { "-D", 0b0001111 },
+	{ "-A", 0b0110011 }, { "D+1", 0b0011111 }, { "A+1", 0b0110111 }, { "D-1", 0b0001110 },
+	{ "A-1", 0b0110010 }, { "D+A", 0b0000010 }, { "A+D", 0b0000010 }, { "D-A", 0b0010011 },
+	{ "A-D", 0b0000111 }, { "D&A", 0b0000000 }, { "A&D", 0b0000000 }, { "D|A", 0b0010101 },
+	{ "A|D", 0b0010101 }, { "M", 0b1110000 }, { "!M", 0b1110001 }, { "-M", 0b1110011 },
+	{ "M+1", 0b1110111 }, { "M-1", 0b1110010 }, { "D+M", 0b1000010 }, { "M+D", 0b1000010 },
+	{ "D-M", 0b1010011 }, { "M-D", 0b1000111 }, { "D&M", 0b1000000 }, { "M&D", 0b1000000 },
+	{ "D|M", 0b1010101 }, { "M|D", 0b1010101 } };
+// Indexed by the jump bits of a C-instruction
+constexpr const char* jumpMnemonics[] = { "", "JGT", "JEQ", "JGE", "JLT", "JNE", "JLE", "JMP" };
+/*
+	Functionality: Tells if the first length characters of text are the whole of name.
+*/
+constexpr bool sameText(const char* text, size_t length, const char* name)
+{
+	for (size_t i = 0; i < length; i++)
+	{
+		if (name[i] != text[i]) return false;
+	}
+	return name[length] == '\0';
+}
+/*
+	Functionality: Returns the value of a predefined symbol or of a decimal constant, or -1 if the
+	               text is neither, so it is a label or a variable.
+*/
+constexpr int hackSymbolValue(const char* text, size_t length)
+{
+	for (const PredefinedSymbol& symbol : predefinedSymbols)
+	{
+		if (sameText(text, length, symbol.name)) return symbol.value;
+	}
+	int number = 0;
+	for (size_t i = 0; i < length; i++)
+	{
+		bool characterIsDigit = (text[i] >= '0' && text[i] <= '9');
+		if (!characterIsDigit || number > 32767) return -1;
+		number = number * 10 + (text[i] - '0');
+	}
+	return (length > 0 && number <= 32767) ? number : -1;
+}
+/*
+	Functionality: Returns the jump bits of a jump mnemonic, or -1 if it is not one.
+*/
+constexpr int hackJumpBits(const char* text, size_t length)
+{
+	for (int bits = 0; bits < 8; bits++)
+	{
+		if (sameText(text, length, jumpMnemonics[bits])) return bits;
+	}
+	return -1;
+}
+/*
+	Functionality: Returns the machine word of a C-instruction, dest=comp;jump, or -1 if it is not
+	               valid HACK assembly.
+*/
+constexpr int encodeCInstruction(const char* text, size_t length)
+{
+	size_t compStart = 0;
+	size_t compEnd = length;
+	int destBits = 0;
+	int jumpBits = 0;
+	for (size_t i = 0; i < length; i++)
+	{
+		if (text[i] == '=' && compStart == 0)
+		{
+			for (size_t j = 0; j < i; j++)
+			{
+				if (text[j] == 'A') destBits |= 4;
+				else if (text[j] == 'D') destBits |= 2;
+				else if (text[j] == 'M') destBits |= 1;
+				else return -1;
+			}
+			compStart = i + 1;
+		}
+		else if (text[i] == ';')
+		{
+			compEnd = i;
+			jumpBits = hackJumpBits(text + i + 1, length - i - 1);
+			if (jumpBits < 0) return -1;
+			break;
+		}
+	}
+	for (const Computation& computation : computations)
+	{
+		if (sameText(text + compStart, compEnd - compStart, computation.mnemonic))
+		{
+			return 0b1110000000000000 | (computation.bits << 6) | (destBits << 3) | jumpBits;
+		}
+	}
+	return -1;
+}
+/*
+	Functionality: A line of a snippet, assembled as far as it can be at compile time.
+
+	Kinds:         ITEM_WORD       - A machine word that is fully known
+	               ITEM_JUMP       - A C-instruction whose jump is an operand, like D;J%. The word
+				                     holds the rest of it
+				   ITEM_REFERENCE  - An A-instruction that names a symbol or holds an operand,
+				                     like @%$% or @TRUE. Its text is what follows the '@'
+				   ITEM_DEFINITION - A label declaration, like (%$%). Its text is the label
+*/
+enum SnippetItemKind : uint8_t
+{
+	ITEM_WORD,
+	ITEM_JUMP,
+	ITEM_REFERENCE,
+	ITEM_DEFINITION
+};
+struct SnippetItem
+{
+	SnippetItemKind kind;
+	uint8_t firstOperand;    // the operand the first '%' of the line stands for
+	uint16_t word;
+	uint16_t textPos;
+	uint16_t textLength;
+};
+/*
+	Functionality: A fixed piece of HACK assembly text. The places where an operand (an index, a
+	               label, an address) goes are marked with '%'. Everything else about the snippet
+				   is worked out at compile time: its length, where each operand goes, how many ROM
+				   words it assembles to and the machine words themselves, so none of it is
+				   counted or assembled by hand.
+*/
+struct Snippet
+{
+	const char* text;
+	size_t length;
+	int romWords;
+	int operandCount;
+	size_t operandPos[12];
+	bool assembles;          // false if a line is not valid HACK assembly
+	int itemCount;
+	SnippetItem items[64];
+};
+/*
+	Functionality: Assembles a line of a snippet into an item. Comments and empty lines have none.
+*/
+constexpr void assembleSnippetLine(Snippet& snippet, size_t lineStart, size_t lineEnd, int firstOperand)
+{
+	const char* line = snippet.text + lineStart;
+	size_t length = lineEnd - lineStart;
+	bool lineIsComment = (length >= 2 && line[0] == '/' && line[1] == '/');
+	if (length == 0 || lineIsComment) return;
+
+	bool lineHasOperand = false;
+	for (size_t i = 0; i < length; i++) lineHasOperand = (lineHasOperand || line[i] == '%');
+
+	SnippetItem item = {};
+	item.firstOperand = (uint8_t)firstOperand;
+	if (line[0] == '(')
+	{
+		item.kind = ITEM_DEFINITION;
+		item.textPos = (uint16_t)(lineStart + 1);
+		item.textLength = (uint16_t)(length - 2);
+	}
+	else if (line[0] == '@')
+	{
+		int value = (lineHasOperand ? -1 : hackSymbolValue(line + 1, length - 1));
+		item.kind = (value >= 0 ? ITEM_WORD : ITEM_REFERENCE);
+		item.word = (uint16_t)(value >= 0 ? value : 0);
+		item.textPos = (uint16_t)(lineStart + 1);
+		item.textLength = (uint16_t)(length - 1);
+	}
+	else
+	{
+		bool jumpIsOperand = (length >= 3 && sameText(line + length - 3, 3, ";J%"));
+		int word = encodeCInstruction(line, jumpIsOperand ? length - 3 : length);
+		if (word < 0 || (lineHasOperand && !jumpIsOperand)) snippet.assembles = false;
+		item.kind = (jumpIsOperand ? ITEM_JUMP : ITEM_WORD);
+		item.word = (uint16_t)word;
+	}
+	if (item.kind != ITEM_DEFINITION) snippet.romWords++;
+	snippet.items[snippet.itemCount++] = item;
+}
+/*
+	Functionality: Builds a snippet from its text. A line counts as a ROM word unless it is empty,
+	               a comment or a label declaration.
+*/
+constexpr Snippet makeSnippet(const char* text)
+{
+	Snippet snippet = {};
+	snippet.text = text;
+	snippet.assembles = true;
+	size_t lineStart = 0;
+	int firstOperandOfLine = 0;
+	size_t pos = 0;
+	for (;; pos++)
+	{
+		char character = text[pos];
+		if (character == '%') snippet.operandPos[snippet.operandCount++] = pos;
+		bool lineEnds = (character == '\n' || character == '\0');
+		if (lineEnds)
+		{
+			assembleSnippetLine(snippet, lineStart, pos, firstOperandOfLine);
+			lineStart = pos + 1;
+			firstOperandOfLine = snippet.operandCount;
+		}
+		if (character == '\0') break;
+	}
+	snippet.length = pos;
+	return snippet;
+}
+/*
+	Functionality: A snippet operand, as the machine code writer sees it: text, a number or a label.
+*/
+struct SnippetOperand
+{
+	const char* text;
+	size_t length;
+	bool isNumber;
+	int number;
+	int label;               // -1 unless the operand is a label
+	char digits[12];
+
+	SnippetOperand(int value) : text(digits), isNumber(true), number(value), label(-1)
+	{
+		length = to_chars(digits, digits + sizeof(digits), value).ptr - digits;
+	}
+	SnippetOperand(const char* value) : text(value), length(strlen(value)), isNumber(false), number(0), label(-1) {}
+	SnippetOperand(const string& value) : text(value.data()), length(value.size()), isNumber(false), number(0), label(-1) {}
+	SnippetOperand(CodeLabel value) : text(""), length(0), isNumber(false), number(0), label(value.id) {}
+	SnippetOperand(const SnippetOperand&) = delete;
+
+	string_view textOf() const { return isNumber ? string_view(digits, length) : string_view(text, length); }
+};
+/*
+	Functionality: HACK machine code that still names some symbols. Code translated on its own
+	               starts at address 0 and is moved to its real address when it is linked.
+
+	Fields:        words       - The machine words
+	               relocations - The words that hold a ROM address relative to the code's start
+				   symbols     - The name of every symbol the code names, once, indexed by its id
+				   references  - The words that hold the address of a symbol, and the symbol's id
+				   definitions - The labels declared in the code, and their addresses
+*/
+struct SymbolReference
+{
+	size_t word;
+	int symbol;
+};
+struct SymbolDefinition
+{
+	int symbol;
+	int address;
+};
+struct MachineCode
+{
+	vector<uint16_t> words;
+	vector<size_t> relocations;
+	vector<string> symbols;
+	vector<SymbolReference> references;
+	vector<SymbolDefinition> definitions;
+};
+/*
+	This class contains all the methods necessary to translate an instruction from JACK VM code
+	to HACK assembly language and output the translation into an output file.
+*/
+class CodeWriter
+{
+private:
+	string outputFileName;
+	string fileWOExtension;
+	FileSink outputFile;
+	AssemblyBuffer assemblyCode;
+	int writtenInstructionsSoFar;
+	const SymbolTable* symbols;           // where the ids of labels and functions are named
+	int currentFunction;                  // the function labels belong to, -1 outside of any
+	bool recordsRomAddresses;
+	vector<size_t> romAddressOffsets;     // where each ROM address operand was written
+
+	struct LabelInfo
+	{
+		int address;                      // -1 until the label is placed
+		int waitingReferences;            // references written before the label was placed
+	};
+	struct LabelFixup
+	{
+		size_t offset;                    // where in unresolvedCode the address goes
+		int label;
+	};
+	vector<LabelInfo> labels;
+	vector<LabelFixup> labelFixups;
+	int referencesWaiting;                // references to labels that are not placed yet
+	AssemblyBuffer unresolvedCode;        // code written since the first of those references
+	AssemblyBuffer* output;               // assemblyCode, or unresolvedCode while references wait
+	bool writesMachineCode;
+	MachineCode machineCode;
+	unordered_map<string, int> machineSymbolIds;
+	string symbolName;                    // the name of the symbol being encoded
+
+	/*
+		Functionality: Copies a snippet to the output, putting the received operands, in order, in
+		               place of its '%' marks, and adds its ROM words to the written instruction
+					   count.
+	*/
+	template <typename... Operands>
+	void emit(const Snippet& snippet, const Operands&... operands);
+	/*
+		Functionality: Appends the machine words of a snippet to the machine code, with the received
+		               operands in place.
+	*/
+	void encode(const Snippet&, const SnippetOperand*);
+	/*
+		Functionality: Appends an A-instruction holding the value of the named symbol. If the name
+		               is not a predefined symbol or a constant, the word is left to the linker.
+	*/
+	void encodeReference(const string& name);
+	/*
+		Functionality: Returns the id of a symbol of the machine code, giving it one the first time
+		               it is named.
+	*/
+	int machineSymbolOf(const string& name);
+	/*
+		Functionality: Returns the name of the function labels belong to, "main" outside of any.
+	*/
+	const string& currentFunctionName() const;
+	/*
+		Functionality: Returns a new label, not placed yet.
+	*/
+	CodeLabel newLabel();
+	/*
+		Functionality: Places the label at the next instruction to be written. Once every label
+		               referred to so far is placed, lays out the code that waited for them.
+	*/
+	void placeLabel(CodeLabel);
+	/*
+		Functionality: Writes the address of the label, or leaves room for it in the code waiting
+		               for labels if it is not known yet.
+	*/
+	void writeAddressOf(CodeLabel);
+	/*
+		Functionality: Moves the code that waited for labels to the output, with the address of
+		               every label it refers to in place.
+	*/
+	void layOutUnresolvedCode();
+	/*
+		Functionality: Forgets every label, so a new module or file starts numbering them again.
+	*/
+	void resetLabels();
+	/*
+		Functionality: Forgets the labels of the commands translated before. A label is only
+		               referred to by the command that makes it, so once no code waits for one,
+					   none of them is needed again. This keeps the labels as few as a single
+					   command needs, however long the translation runs.
+	*/
+	void forgetOldLabels();
+
+public:
+	/*
+		Functionality: Makes a writer that names labels and functions through the received symbol
+		               table. Only a writer that writes the preamble alone can do without one.
+	*/
+	explicit CodeWriter(const SymbolTable* symbolTable = nullptr) : writtenInstructionsSoFar(0),
+		symbols(symbolTable), currentFunction(-1), recordsRomAddresses(false), referencesWaiting(0),
+		unresolvedCode(0), output(&assemblyCode), writesMachineCode(false) {}
+	CodeWriter(const CodeWriter&) = delete;
+	CodeWriter& operator=(const CodeWriter&) = delete;
+	~CodeWriter();
+
+	/*
+		Functionality: Writes everything still buffered to the output file.
+	*/
+	void flush() { assemblyCode.flush(); }
+	/*
+		Functionality: Writes everything still buffered to the output file and closes it. Returns
+		               false if any of the code could not be written.
+	*/
+	bool finish() { assemblyCode.flush(); return outputFile.close(); }
+	size_t getBytesWritten() { return assemblyCode.getBytesWritten(); }
+	int getFlushCount() { return assemblyCode.getFlushCount(); }
+	string getOutputFileName() { return outputFileName; }
+	/*
+		Functionality: Receives a string, c, that contains an arithmetic command in JACK VM
+					   language, and outputs the translation to HACK assembly to the output file.
+	*/
+	void writeArithmetic(Opcode);
+	void writePushPop(Opcode, Segment, int);
+	/*
+		What it does: Writes the needed preamble for every translated file. It sets up the stack
+		              pointer to 256, calls the sys.init() function of the operating system, and 
+					  writes the code for the all the comparisons in the program.
+	*/
+	void writeInit();
+	/*
+		What it does: It handles the initializing of variables and writing of the bootstrap code
+		              The functionality depends on the number files that have been translated when 
+					  it is called.
+
+	    Assumptions: 1. This is only called when the driver is dealing with a folder with
+			            multiple VM files.
+				     2. The file counter is never less than zero
+
+	    Inputs:      1. A string containing the input file name
+			         2. An int that indicates how many files have been translated thus far.
+	*/
+	void initialize(string, int);
+	/*
+		What it does: Same as initialize for the first file, but hands the code to the received
+		              sink instead of opening an output file.
+	*/
+	void initializeStream(string, OutputSink&);
+	/*
+		What it does: Prepares the writer to translate a single module into its own in-memory
+		              buffer. Nothing is written to a file.
+
+		Inputs:      1. A string containing the input file name
+		             2. An int with the ROM address the module's first instruction will have
+	*/
+	void beginModule(string, int);
+	/*
+		What it does: Appends already translated assembly code, such as a module translated by
+		              another writer, to the output.
+	*/
+	void writeCode(string_view code) { *output << code; }
+	/*
+		What it does: Moves the code translated so far out of an in-memory writer.
+	*/
+	string takeCode() { return assemblyCode.takeContents(); }
+	/*
+		What it does: Returns the ROM words written so far, which is exactly the ROM the code
+		              takes, since every instruction is counted as it is written.
+	*/
+	int getWrittenInstructions() { return writtenInstructionsSoFar; }
+	/*
+		What it does: Makes an in-memory writer remember where in its code it writes each ROM
+		              address, so the code can be moved to another address later.
+	*/
+	void recordRomAddresses() { recordsRomAddresses = true; }
+	/*
+		What it does: Moves the offsets of the ROM addresses written so far out of the writer.
+	*/
+	vector<size_t> takeRomAddressOffsets() { return move(romAddressOffsets); }
+	/*
+		What it does: Makes an in-memory writer encode HACK machine words instead of writing
+		              assembly text. ROM addresses are recorded as relocations of the machine
+					  code, if asked to.
+	*/
+	void writeMachineCode() { writesMachineCode = true; }
+	/*
+		What it does: Moves the machine code encoded so far out of the writer.
+	*/
+	MachineCode takeMachineCode() { machineSymbolIds.clear(); return move(machineCode); }
+	/*
+		What it does: Writes HACK assembly code that effects the "label" command.
+
+		Assumptions:  1. Will not be called if there is no label command.
+					  2. The label is error free
+					  3. The input refers to a label that has not been used before inside the
+					     current function.
+
+		Inputs:       1. An int, l, the id of the label in the symbol table.
+	*/
+	void writeLabel(int);
+	/*
+		What it does: Writes HACK assembly code that effects the JACK VM "goto" command.
+
+		Assumptions:
+		1. The label is always within some function.
+		2. The passed label contains no mistakes.
+		3. The compiler takes care of returning to the correct instruction after the jump.
+
+		Inputs:
+		1. An int, l, the id in the symbol table of the label to which to jump.
+
+	*/
+	void writeGOTO(int);
+	/*
+		What it does: Writes HACK assembly code that effects the JACK VM if-goto command.
+
+		Assumptions:
+
+		  1. The label to which to jump is always inside a function.
+		  2. Label has not errors.
+		  3. The compiler translates where to jump if the jump is taken.
+
+		Inputs:
+
+		  1. An int, l, the id in the symbol table of the label to which to jump if the condition
+		     is met.
+
+	*/
+	void writeIf(int);
+	/*
+		What it does: Writes HACK assembly code that effects the JACK VM "call" command.
+
+		Assumptions:
+
+		Inputs:
+
+			1. An int, fn, the id in the symbol table of the called function.
+			2. An int, na, that contains the number of arguments of the function.
+
+	*/
+	void writeCall(int, int);
+	/*
+		What it does: Writes the HACK assembly instructions that effect the "return" JACK VM command.
+
+	*/
+	void writeReturn();
+
+	void writeFunction(int, int);
+	/*
+		What it does: Returns the ROM words of the code of a call and of a return. Neither jumps
+		              until its last instruction, so these are also the cycles each takes.
+	*/
+	static int getCallRomWords();
+	static int getReturnRomWords();
+};
+/*
+	Functionality: Writes a VM program as a portable C program instead of HACK assembly, with one
+	               C function per VM function. The C program keeps the state of the VM where the
+				   HACK code does, in a RAM of 32K words laid out like the HACK RAM, and builds the
+				   frame of writeCall on every call and takes it down like writeReturn, but returns
+				   through the C stack. Compiled with the system compiler, it runs natively and
+				   reports how it stopped and what it left in temp.
+
+	               It has the write methods of CodeWriter, so translateInstruction and
+				   translateModule take either one as their writer. Which one is chosen when they
+				   are compiled, and each instruction is a direct call to the writer.
+
+	               Like the HACK code, the C program calls Sys.init with no arguments and halts when
+				   it returns or a goto jumps to itself. Without Sys.init, it runs the code outside
+				   functions of every file, in order.
+*/
+class CSourceWriter
+{
+private:
+	const SymbolTable* symbols;
+	string fileWOExtension;
+	string prototypes;
+	string functionCode;
+	int currentFunction;                  // the VM function being written, -1 outside of any
+	bool functionIsOpen;
+	bool functionEndsInJump;              // whether its last command was a return or a goto
+	int lastLabel;                        // the label right before the next command, -1 if none
+	set<int> declaredLabels;              // of the open function
+	set<int> usedLabels;                  // of the open function
+	set<int> definedFunctions;
+	set<int> calledFunctions;
+	vector<string> outsideFunctionParts;  // the C functions with the code outside VM functions
+	map<pair<string, int>, int> staticAddresses;
+	int duplicateFunctions;
+	int callCount;
+
+	/*
+		Functionality: Returns the name of the C function of a VM function: its id and its name,
+		               with every character C does not allow in a name as '_'.
+	*/
+	string functionNameOf(int function) const;
+	/*
+		Functionality: Returns the RAM address of a static variable of the current file, giving it
+		               the next one from 16 on the first time it is seen, as the assembler does.
+	*/
+	int staticAddressOf(int index);
+	/*
+		Functionality: Appends a line to the body of the open C function, opening one for the
+		               code outside VM functions if none is.
+	*/
+	void writeLine(const string& line);
+	void openFunction(const string& name);
+	/*
+		Functionality: Ends the open C function. Labels it goes to but does not declare, and
+		               running past the end of a VM function, stop the program.
+	*/
+	void closeFunction();
+
+public:
+	explicit CSourceWriter(const SymbolTable* symbolTable) : symbols(symbolTable), currentFunction(-1),
+		functionIsOpen(false), functionEndsInJump(false), lastLabel(-1), duplicateFunctions(0), callCount(0) {}
+
+	/*
+		What it does: Starts translating a file, outside of any function. Its name names its
+		              static variables.
+	*/
+	void beginModule(string);
+	void writeArithmetic(Opcode);
+	void writePushPop(Opcode, Segment, int);
+	void writeLabel(int);
+	void writeGOTO(int);
+	void writeIf(int);
+	void writeCall(int, int);
+	void writeReturn();
+	void writeFunction(int, int);
+	/*
+		What it does: Writes the C program to the received file: the RAM and the routines every
+		              program uses, the declaration of every function, their code, a function that
+					  stops the program for every VM function called but not defined, and main.
+					  Returns false if the file cannot be written.
+	*/
+	bool writeProgram(const string&);
+};
+/*
+	Functionality: A module translated on its own, as written to an object file (.vmo) and kept in
+	               the translation cache. Its code starts at address 0 and is moved to its real
+				   address when it is linked.
+
+	Fields:        name        - The name of the VM file the module comes from
+	               romWords    - ROM words the module's code takes
+				   exports     - The functions the module defines
+				   imports     - The functions the module calls but does not define
+				   statics     - The static variables the module uses, as they appear in its code
+				   relocations - Offsets in the code of every ROM address in it, in order. The
+				                 addresses are relative to the module's first instruction.
+				   code        - The HACK assembly of the module
+				   machineCode - The HACK machine code of the module, instead of its assembly,
+				                 when it is translated to machine code
+*/
+struct ObjectModule
+{
+	string name;
+	int romWords;
+	vector<string> exports;
+	vector<string> imports;
+	vector<string> statics;
+	vector<size_t> relocations;
+	string code;
+	MachineCode machineCode;
+};
+/*
+	Functionality: What a program is written as: HACK assembly, or HACK machine code assembled by
+	               the translator itself, either as .hack text or as a raw binary ROM image. With
+				   OUTPUT_EMULATION the machine code is run on the HACK CPU emulator instead of
+				   being written.
+*/
+enum OutputFormat
+{
+	OUTPUT_ASSEMBLY,
+	OUTPUT_HACK_TEXT,
+	OUTPUT_HACK_BINARY,
+	OUTPUT_EMULATION
+};
+/*
+	Functionality: A whole program in HACK machine code, preamble included, with every symbol
+	               resolved. Knows where each of its functions starts, in address order.
+*/
+struct HackProgram
+{
+	vector<uint16_t> words;
+	vector<pair<int, string>> functions;    // address, name
+};
+/*
+	Functionality: Runs HACK machine code the way the HACK CPU does, one instruction per cycle,
+	               from address 0 with every register and RAM word at 0. It counts how many
+				   cycles each ROM address takes and the deepest the stack gets. Every word is
+				   decoded once, when the program is loaded. The screen and the keyboard are just
+				   RAM.
+
+	               The program halts when it jumps to a jump to itself, which is how the
+				   translator and the JACK OS stop a program.
+*/
+class HackEmulator
+{
+public:
+	enum StopReason
+	{
+		STOP_HALTED,
+		STOP_CYCLE_LIMIT,
+		STOP_END_OF_ROM
+	};
+
+private:
+	struct DecodedWord
+	{
+		bool isAInstruction;
+		uint8_t computation;    // the a bit and the six ALU bits
+		uint8_t destination;    // A, D and M, from the highest bit down
+		uint8_t jump;           // less than, equal to and greater than 0, from the highest bit down
+		uint16_t value;         // what an A-instruction loads
+	};
+	vector<DecodedWord> rom;
+	vector<uint16_t> ram;
+	vector<uint64_t> addressCycles;
+	uint64_t cycles;
+	int largestStackPointer;
+	StopReason stopReason;
+
+	/*
+		Functionality: Returns what the ALU outputs for the received computation bits, with D as x
+		               and A or M as y.
+	*/
+	static uint16_t compute(uint8_t computation, uint16_t x, uint16_t y);
+
+public:
+	explicit HackEmulator(const vector<uint16_t>& words);
+
+	/*
+		Functionality: Runs the program from its first instruction until it halts, runs past the
+		               end of the ROM or has taken the received number of cycles.
+	*/
+	void run(uint64_t cycleLimit);
+	uint64_t getCycles() const { return cycles; }
+	StopReason getStopReason() const { return stopReason; }
+	/*
+		Functionality: Returns the most words the stack has held above its base, 256.
+	*/
+	int getLargestStackDepth() const { return max(0, largestStackPointer - 256); }
+	const vector<uint64_t>& getAddressCycles() const { return addressCycles; }
+	int16_t getRam(int address) const { return (int16_t)ram[address]; }
+};
+/*
+	Functionality: Runs the parsed VM instructions of a program directly, without lowering them
+	               to HACK, over a RAM of 32K words laid out like the HACK RAM: SP, LCL, ARG, THIS
+				   and THAT in R0-R4, temp in R5-R12, the statics from 16 on, in the order the
+				   assembler would give them, and the stack from 256 on. Push and pop reach the
+				   segments the way writePushPop does, comparisons subtract in 16 bits like the
+				   HACK code, and call and return build and take down the frame writeCall and
+				   writeReturn do. So a program leaves the same values in RAM as its HACK code,
+				   except in R5, R6, R13 and R14, which the HACK code also uses as scratch.
+
+	               Every instruction is decoded once, when the program is loaded, into an operation
+				   with its segment, RAM address and jump target worked out, and labels vanish.
+				   Each operation then jumps straight to the code of the next one (threaded code),
+				   through computed gotos where the compiler has them and a switch elsewhere.
+
+	               Like the HACK code, it calls Sys.init with no arguments, if the program has one,
+				   and halts when Sys.init returns or a goto jumps to itself. A program without
+				   Sys.init runs from its first instruction.
+*/
+class VMInterpreter
+{
+public:
+	enum StopReason
+	{
+		STOP_HALTED,
+		STOP_INSTRUCTION_LIMIT,
+		STOP_END_OF_CODE,
+		STOP_UNDEFINED_SYMBOL
+	};
+	static const int ramWords = 32768;
+
+private:
+	enum Operation : uint8_t
+	{
+		RUN_ADD,
+		RUN_SUB,
+		RUN_NEG,
+		RUN_EQ,
+		RUN_GT,
+		RUN_LT,
+		RUN_AND,
+		RUN_OR,
+		RUN_NOT,
+		RUN_PUSH_CONSTANT,
+		RUN_PUSH_THROUGH_POINTER,
+		RUN_PUSH_REGISTER,
+		RUN_POP_THROUGH_POINTER,
+		RUN_POP_REGISTER,
+		RUN_GOTO,
+		RUN_IF_GOTO,
+		RUN_FUNCTION,
+		RUN_CALL,
+		RUN_RETURN,
+		RUN_HALT,
+		RUN_END_OF_CODE,
+		RUN_UNDEFINED_SYMBOL
+	};
+	struct DecodedInstruction
+	{
+		Operation operation;
+		uint8_t pointer;    // the register that holds the base of a segment reached through it
+		uint16_t value;     // a constant, a RAM address, a segment index, nLocals or nArgs
+		int target;         // where a goto, an if-goto or a call goes
+	};
+	vector<DecodedInstruction> code;
+	vector<uint16_t> ram;
+	vector<int> returnAddresses;
+	int entry;
+	bool hasSysInit;
+	uint64_t instructions;
+	uint64_t calls;
+	StopReason stopReason;
+
+public:
+	explicit VMInterpreter(const Program& program);
+
+	/*
+		Functionality: Runs the program from its entry until it halts, runs past the end of its
+		               code, reaches a symbol nobody defines or has run the received number of
+					   instructions.
+	*/
+	void run(uint64_t instructionLimit);
+	bool callsSysInit() const { return hasSysInit; }
+	uint64_t getInstructions() const { return instructions; }
+	uint64_t getCalls() const { return calls; }
+	StopReason getStopReason() const { return stopReason; }
+	int16_t getRam(int address) const { return (int16_t)ram[address & (ramWords - 1)]; }
+};
+/*
+	Functionality: What the code writer did with the instructions one thread translated: how many
+	               of each opcode and segment, and the time and ROM words each command type and
+				   each function took. Kept by the thread alone and added to the stats at the end.
+*/
+struct CodeGenerationCounts
+{
+	size_t opcodes[OP_RETURN + 1];
+	size_t segments[SEG_TEMP + 1];
+	size_t commands[C_CALL + 1];
+	long long commandNanoseconds[C_CALL + 1];
+	long long commandRomWords[C_CALL + 1];
+	vector<pair<int, int>> functionRomWords;    // function id, ROM words of its code
+};
+/*
+	Functionality: What the translator measures about itself when asked to with --stats, written
+	               as JSON once the program is written. The phases are discovery, parsing, code
+				   generation and output; since files and functions are translated on several
+				   threads at once, the time of a phase adds up the time of every thread in it.
+*/
+class TranslationStats
+{
+public:
+	enum Phase
+	{
+		PHASE_DISCOVERY,
+		PHASE_PARSING,
+		PHASE_CODE_GENERATION,
+		PHASE_OUTPUT,
+		PHASE_COUNT
+	};
+
+	TranslationStats();
+
+	void addPhaseTime(Phase, chrono::steady_clock::duration);
+	/*
+		Functionality: Adds what a thread counted, naming its functions through the symbol table
+		               of the program they come from.
+	*/
+	void addCounts(const CodeGenerationCounts&, const SymbolTable&);
+	void addOutput(size_t bytesWritten, int romWords);
+	/*
+		Functionality: Writes the stats, with the peak memory of the process, to a JSON file.
+	*/
+	bool writeJson(const string& fileName) const;
+
+private:
+	mutable mutex statsMutex;
+	chrono::steady_clock::time_point start;
+	long long phaseNanoseconds[PHASE_COUNT];
+	CodeGenerationCounts counts;
+	map<string, long long> functionRomWords;
+	size_t outputBytes;
+	long long programRomWords;
+};
+/*
+	Functionality: The stats being kept, or nullptr when they are not asked for, which is the
+	               only cost they have then.
+*/
+TranslationStats* translationStats = nullptr;
+/*
+	Functionality: Adds the time from its construction to its destruction to a phase of the stats,
+	               if there are any.
+*/
+class PhaseTimer
+{
+private:
+	TranslationStats::Phase phase;
+	chrono::steady_clock::time_point start;
+
+public:
+	PhaseTimer(TranslationStats::Phase measuredPhase) : phase(measuredPhase)
+	{
+		if (translationStats != nullptr) start = chrono::steady_clock::now();
+	}
+	~PhaseTimer()
+	{
+		if (translationStats != nullptr) translationStats->addPhaseTime(phase, chrono::steady_clock::now() - start);
+	}
+	PhaseTimer(const PhaseTimer&) = delete;
+	PhaseTimer& operator=(const PhaseTimer&) = delete;
+};
+/*
+	Functionality: Keeps an object module for every VM file translated, named after a hash of the
+	               file's VM code, its name, whether it was translated to machine code and the code
+				   generator itself. A file whose VM code has not changed since it was last
+				   translated the same way is linked from the cache instead of being translated
+				   again.
+*/
+class TranslationCache
+{
+private:
+	string folder;
+
+	string entryPath(uint64_t key) const;
+
+public:
+	/*
+		Functionality: Uses the received folder for the cache, creating it if needed.
+	*/
+	TranslationCache(string folderName);
+
+	/*
+		Functionality: Returns the key of a module from its VM code, its name and whether it is
+		               translated to machine code or to assembly. Any change to the HACK snippets
+					   changes every key.
+	*/
+	static uint64_t keyOf(string_view vmCode, const string& moduleName, bool toMachineCode);
+	/*
+		Functionality: Loads the module stored under the received key. Returns false if there is
+		               none or it cannot be read.
+	*/
+	bool load(uint64_t key, ObjectModule&) const;
+	/*
+		Functionality: Stores the module under the received key, replacing what was there.
+	*/
+	void store(uint64_t key, const ObjectModule&) const;
+};
+#ifdef _WIN32
+/*
+	What it does:
+	    Assumptions:
+		    1. Command argument is a folder
+		Inputs:
+		    1. A string containing the name of the folder
+		Output:
+		    1. A string with the path to the folder to traverse
+*/
+string getPath(string);
+#endif
+/*
+	What it does:
+
+	Assumptions:
+	               1. There is a folder to traverse for files with VM code
+	Inputs:
+	               1. A string containing each item inside the folder being traversed
+	Output:
+	               1. True if the current file being traversed is a VM file. Otherwise, false.
+*/
+bool fileIsVMFile(string);
+/*
+	What it does: Returns the name of the file a path ends in, without the folders before it.
+*/
+string fileNameOf(const string&);
+/*
+	What it does: Returns the name of the file a path ends in without its extension, which
+	              starts at the last dot of the name. Modules and output files are named this way.
+*/
+string withoutExtension(const string&);
+/*
+	What it does: Returns true if the received path names a folder, following links. Returns
+	              false if it names a file or nothing.
+*/
+bool pathIsFolder(const string&);
+/*
+	What it does: Parses a whole VM file and appends its instructions to the program as a new
+	              module.
+
+	Inputs:
+	               1. A string with the path of the file to parse
+				   2. A string with the name of the file, used for its static variables
+				   3. The program the instructions are added to
+*/
+void parseModule(string, string, Program&);
+/*
+	What it does: Same as above, for a file that has already been read.
+*/
+void parseModule(IngestedFile&&, string, Program&);
+void addModule(string, size_t, Program&);
+/*
+	What it does: Translates every instruction of a module of the program through the writer.
+	              The writer is the backend: CodeWriter for HACK, or CSourceWriter for C. It is
+				  a template argument, so every instruction is a direct call to it.
+
+	Assumptions:
+	               1. The writer has been initialized for the module's file.
+*/
+template <typename Writer>
+void translateModule(Writer&, const Program&, const Module&);
+/*
+	What it does: Same as translateModule, but times every instruction and counts what it
+	              translates into the received counts.
+*/
+void translateModuleMeasured(CodeWriter&, const Program&, const Module&, CodeGenerationCounts&);
+/*
+	What it does: Translates a single instruction through the writer, HACK or C.
+*/
+template <typename Writer>
+void translateInstruction(Writer&, const Instruction&);
+/*
+	What it does: Translates every module of a program to a single C program, named after the
+	              first one with the .c extension. Returns false if it could not be written.
+*/
+bool writeCProgram(const Program&);
+/*
+	What it does: Translates a single VM file with two threads working at the same time: a parser
+	              thread decodes the file and hands batches of instructions through a ring to
+				   the calling thread, which writes their code. Reports how often each side had to
+				   wait for the other.
+
+	Inputs:
+	               1. A string with the name of the file
+	Output:
+	               1. False if the assembly could not be written. Otherwise, true
+*/
+bool translateFilePipelined(string);
+/*
+	What it does: Translates VM code read from the standard input, or from the received files one
+	              after the other, and writes the assembly to the standard output as it goes. Only
+				  a block of the input and a block of the output are held in memory at a time,
+				  however large the input is. Lines longer than 64 KB are skipped, and bytecode
+				  is not read, since it can't be split into blocks.
+
+	Inputs:
+	               1. The names of the files, where "-" is the standard input. Static variables
+				      are named after them, and "Stdin" for the standard input
+	Output:
+	               1. False if an input could not be opened, was bytecode or had a line too long.
+				      Otherwise, true
+*/
+bool translateStream(const vector<string>&);
+/*
+	What it does: Reads whatever input is available, up to the received number of bytes, waiting
+	              for no more than a single read. Returns 0 at the end of the input.
+*/
+size_t readAvailableInput(FILE*, char*, size_t);
+/*
+	What it does: Keeps translating a folder until the program is stopped. Translates and links
+	              every VM file once, and then, every time VM files change, are added or are
+				  removed, translates only those again and links the program once more. The
+				  object modules of the files that did not change are kept in memory.
+
+	Inputs:
+	               1. A string with the path of the folder
+				   2. What to write the program as
+				   3. The translation cache, or nullptr to translate every file
+*/
+void watchFolder(const string&, OutputFormat, TranslationCache*);
+/*
+	What it does: Returns the signature of a file, or one with size -1 if the file can't be found.
+*/
+FileSignature signatureOf(const string&);
+/*
+	What it does: Returns the most memory the process has had resident so far, in bytes.
+*/
+size_t peakMemoryInBytes();
+/*
+	What it does: Returns the received text as a JSON string, quotes included.
+*/
+string jsonString(string_view);
+/*
+	What it does: Generates a VM program that looks like what the JACK compiler writes, with about
+	              the received number of lines. The same seed always gives the same program.
+				  Its functions call the ones after them, so the call graph is as deep as there
+				  are functions, and they are full of while and if labels and of pushes and pops
+				  to every segment.
+
+	Inputs:
+	               1. The number of lines of the program
+				   2. The seed of the random numbers
+*/
+string generateVMProgram(size_t, uint64_t);
+/*
+	What it does: Measures how fast the parser alone, the code writer alone and the whole
+	              translation go through a generated program, and reports, for each, the median
+				  of the runs in lines and MB of VM code per second, with how much the runs spread.
+
+	Inputs:
+	               1. The number of lines of the generated program
+				   2. The seed it is generated with
+				   3. How many measured runs to make, after one that is not measured
+*/
+void runBenchmark(size_t, uint64_t, int);
+/*
+	What it does: Runs work(0) ... work(count - 1) on a pool of worker threads, one per core.
+	              Each thread keeps taking the next item nobody has claimed until none is left.
+*/
+template <typename Work>
+void runInParallel(size_t, Work);
+/*
+	What it does: Translates every VM file of a folder into an object module of its own, in
+	              parallel and largest file first. With a cache, unchanged files are taken from
+				  it instead of being translated.
+
+	Inputs:
+	               1. The VM files
+				   2. The translation cache, or nullptr to translate every file
+				   3. Whether to translate to machine code instead of assembly
+	Output:
+	               1. The object modules, in the order of the files
+*/
+vector<ObjectModule> compileFilesInParallel(const vector<SourceFile>&, TranslationCache*, bool toMachineCode);
+/*
+	What it does: Translates a module of a program into an object module, of assembly or of machine
+	              code. If asked to, its functions are translated in parallel, each into a buffer of
+				  its own.
+*/
+ObjectModule compileModule(const Program&, const Module&, bool functionsInParallel, bool toMachineCode);
+/*
+	What it does: Appends code translated on its own to the received code, adding the received
+	              amount to every ROM address in it, and records where those addresses end up.
+*/
+void appendRelocated(string&, vector<size_t>&, string_view, const vector<size_t>&, int);
+/*
+	What it does: Joins pieces of machine code translated on their own into one that starts at
+	              address 0, each piece moved to the address where the previous one ends.
+*/
+MachineCode joinMachineCode(const vector<const MachineCode*>&);
+/*
+	What it does: Joins object modules into a single program, named after the first one, with the
+	              preamble in front. Reports functions defined twice and modules whose static
+				  variables clash, and if asked to, functions nobody defines. Returns false if the
+				  program could not be written.
+*/
+bool linkModules(const vector<ObjectModule>&, bool reportUndefinedCalls, OutputFormat);
+/*
+	What it does: Joins object modules translated to machine code into a single HACK program,
+	              named after the first one, with the preamble in front, and writes it as .hack
+				  text or as a raw binary ROM image (.bin). Returns false if it could not be
+				  written.
+*/
+bool assembleModules(const vector<ObjectModule>&, OutputFormat);
+/*
+	What it does: Joins object modules translated to machine code into a single HACK program,
+	              with the preamble in front, and resolves every symbol in it.
+*/
+HackProgram assembleProgram(const vector<ObjectModule>&);
+/*
+	What it does: Runs a program on the HACK CPU emulator and reports the cycles it took, in all
+	              and in the code of each function, the ROM words it takes, and the deepest its
+				  stack got.
+
+	Inputs:
+	               1. The program
+				   2. The name it is reported with
+*/
+void runOnEmulator(const HackProgram&, const string&);
+/*
+	What it does: Translates each of a fixed set of VM programs to machine code, runs it on the
+	              HACK CPU emulator the received number of times, and reports the cycles, ROM
+				  words and stack depth of each, whether it computed the right result, and how
+				  fast the emulator ran.
+*/
+void runEmulatorBenchmark(int);
+/*
+	What it does: Runs the parsed instructions of a program on the VM interpreter, and reports how
+	              it stopped, the VM instructions and calls it ran, how fast, and what it left in
+				  temp.
+
+	Inputs:
+	               1. The program
+				   2. The name it is reported with
+*/
+void runOnInterpreter(const Program&, const string&);
+/*
+	What it does: Runs each of the programs of the emulator benchmark on the VM interpreter and,
+	              translated to machine code, on the HACK CPU emulator, the received number of
+				  times, and reports whether each computed the right result and how much faster
+				  the interpreter was.
+*/
+void runInterpreterBenchmark(int);
+/*
+	What it does: Writes the code of an object module through the writer, moved so it starts at
+	              the received ROM address.
+*/
+void writeRelocated(CodeWriter&, const ObjectModule&, int);
+/*
+	What it does: Reports how much was written to the output file of the writer and how many ROM
+	              words the program takes, and warns if the program does not fit in the ROM.
+*/
+void reportWrittenProgram(const string& fileName, size_t bytesWritten, int flushCount, int romWords);
+/*
+	What it does: Object files are a line with their format, the module name, a line with the
+	              counts of what follows, the exports, imports, statics and relocations one per
+				  line, a line with the counts of the machine code, its words, relocations,
+				  symbols, references and definitions one per line, and then the code as it is.
+				  Objects in the first format, which had no machine code, are still read.
+*/
+string serializeObject(const ObjectModule&);
+bool deserializeObject(string_view, ObjectModule&);
+/*
+	What it does: Reads and writes object files. Writing goes through a file of its own that is
+	              then renamed over the old one, so a run that stops halfway never leaves a
+				  broken object behind.
+*/
+bool loadObject(const string&, ObjectModule&);
+bool saveObject(const string&, const ObjectModule&);
+/*
+	What it does: Writes the received bytes to a file the same way objects are written.
+*/
+bool writeWholeFile(const string&, string_view);
+/*
+	What it does: Encodes a module of a program in the binary VM form (.vmb).
+*/
+string encodeBytecode(const Program&, const Module&);
+/*
+	What it does: Converts VM files to the binary form. Each one is written to the current folder
+	              with the .vmb extension. Returns false if any of them could not be written.
+*/
+bool writeBytecodeFiles(const vector<SourceFile>&);
+/*
+	What it does: Finds every VM file in the received folder and, except on Windows, in all the
+	              folders inside it, which are searched in parallel. Folders whose names start
+				  with a dot are skipped, and so are links to folders.
+
+	Inputs:
+	               1. A string with the path of the folder
+	Output:
+	               1. The VM files found, sorted by path, with their sizes. A binary VM file is
+				      left out when the text file it was converted from is next to it
+*/
+vector<SourceFile> discoverVMFiles(string);
+/*
+	What it does: Removes from the received files every binary VM file (.vmb) whose text form
+	              (.vm) is in the same folder, so a folder converted with --bytecode is not
+				  translated twice.
+*/
+void dropConvertedBytecode(vector<SourceFile>&);
+/*
+	What it does: Reads every file of the list whole and pushes it to the queue as soon as it has
+	              been read, so the files can be parsed while the rest are still being read.
+				  Files that cannot be read are pushed empty.
+
+	Inputs:
+	               1. The paths of the files to read
+				   2. The queue the files are pushed to
+*/
+void ingestFiles(const vector<string>&, IngestedFileQueue&);
+/*
+	What it does: Reads the whole received file into the received string, with blocking reads.
+	              Returns false if the file cannot be opened or read.
+*/
+bool readWholeFile(const string&, string&);
+#ifdef VMT_HAS_IO_URING
+/*
+	What it does: Same as ingestFiles, but every open and read is submitted to a single io_uring,
+	              so the reads of all the files are in flight at the same time. Returns false,
+				  having pushed nothing, if the ring cannot be set up.
+*/
+bool ingestFilesWithIoUring(const vector<string>&, IngestedFileQueue&);
+#endif
+/*
+	What it does: Prints how the program is run, with every mode and option it takes.
+*/
+void printUsage();
+
+int main(int argc, char* argv[])
+{
+
+	// Main Logic for the end
+
+	if (argc < 2)
+	{
+		printUsage();
+		return 1;
+	}
+	string input = argv[1];
+	bool inputIsDir = pathIsFolder(input);
+	Program program;
+
+	/*
+		Streams to the standard output: --stream [A.vm B.vm ...], where no file or "-" is the
+		standard input
+	*/
+	if (input == "--stream")
+	{
+		vector<string> inputs(argv + 2, argv + argc);
+		if (inputs.empty()) inputs.push_back("-");
+		return translateStream(inputs) ? 0 : 1;
+	}
+
+	/*
+		Runs a fixed set of programs on the HACK CPU emulator: --cpu-bench [runs]
+	*/
+	if (input == "--cpu-bench")
+	{
+		int runs = (argc > 2 ? atoi(argv[2]) : 5);
+		runEmulatorBenchmark(max(runs, 1));
+		return 0;
+	}
+
+	/*
+		Runs the same programs on the VM interpreter and on the HACK CPU emulator: --vm-bench [runs]
+	*/
+	if (input == "--vm-bench")
+	{
+		int runs = (argc > 2 ? atoi(argv[2]) : 5);
+		runInterpreterBenchmark(max(runs, 1));
+		return 0;
+	}
+
+	/*
+		Measures the translator on a generated program: --bench [lines] [seed] [runs]. With
+		--generate Name.vm [lines] [seed] the program is written to a file instead
+	*/
+	if (input == "--bench" || input == "--generate")
+	{
+		bool writesProgram = (input == "--generate");
+		int firstNumber = (writesProgram ? 3 : 2);
+		size_t lineCount = (argc > firstNumber ? strtoull(argv[firstNumber], nullptr, 10) : 1000000);
+		uint64_t seed = (argc > firstNumber + 1 ? strtoull(argv[firstNumber + 1], nullptr, 10) : 1);
+		int runs = (argc > 4 && !writesProgram ? atoi(argv[4]) : 10);
+		if (!writesProgram)
+		{
+			runBenchmark(lineCount, seed, max(runs, 1));
+			return 0;
+		}
+		if (argc < 3 || !writeWholeFile(argv[2], generateVMProgram(lineCount, seed)))
+		{
+			cout << "Could not write the generated program" << endl;
+			return 1;
+		}
+		cout << "Wrote " << argv[2] << endl;
+		return 0;
+	}
+
+	/*
+		Links object files: --link A.vmo B.vmo ...
+	*/
+	if (input == "--link")
+	{
+		vector<ObjectModule> objects(argc - 2);
+		for (int i = 2; i < argc; i++)
+		{
+			if (!loadObject(argv[i], objects[i - 2]))
+			{
+				cout << "Could not read object file " << argv[i] << endl;
+				return 1;
+			}
+		}
+		bool programWasWritten = (objects.empty() || linkModules(objects, true, OUTPUT_ASSEMBLY));
+		return programWasWritten ? 0 : 1;
+	}
+
+	bool usePipeline = false;
+	bool compileOnly = false;
+	bool convertToBytecode = false;
+	OutputFormat outputFormat = OUTPUT_ASSEMBLY;
+	bool watchForChanges = false;
+	bool interpret = false;
+	bool toC = false;
+	string cacheFolder;
+	string statsFileName;
+	set<string> outputOptions;
+	bool optionsAreValid = true;
+	for (int i = 2; i < argc && optionsAreValid; i++)
+	{
+		string option = argv[i];
+		bool optionTakesValue = (option == "--cache" || option == "--stats");
+		bool valueIsMissing = (optionTakesValue && (i + 1 == argc || string(argv[i + 1]).compare(0, 2, "--") == 0));
+		if (valueIsMissing)
+		{
+			cout << option << " needs a " << (option == "--cache" ? "folder" : "file") << endl;
+			optionsAreValid = false;
+		}
+		else if (option == "--pipeline") usePipeline = true;
+		else if (option == "--compile") { compileOnly = true; outputOptions.insert(option); }
+		else if (option == "--bytecode") { convertToBytecode = true; outputOptions.insert(option); }
+		else if (option == "--hack") { outputFormat = OUTPUT_HACK_TEXT; outputOptions.insert(option); }
+		else if (option == "--rom") { outputFormat = OUTPUT_HACK_BINARY; outputOptions.insert(option); }
+		else if (option == "--run") { outputFormat = OUTPUT_EMULATION; outputOptions.insert(option); }
+		else if (option == "--watch") watchForChanges = true;
+		else if (option == "--interpret") { interpret = true; outputOptions.insert(option); }
+		else if (option == "--c") { toC = true; outputOptions.insert(option); }
+		else if (option == "--cache") cacheFolder = argv[++i];
+		else if (option == "--stats") statsFileName = argv[++i];
+		else
+		{
+			cout << "Unknown option " << option << endl;
+			optionsAreValid = false;
+		}
+	}
+	if (optionsAreValid && outputOptions.size() > 1)
+	{
+		cout << "Only one of --hack, --rom, --run, --interpret, --c, --compile and --bytecode can be given" << endl;
+		optionsAreValid = false;
+	}
+	// Only translations to object modules go through the cache
+	bool cacheIsUnused = (!cacheFolder.empty() && (interpret || toC || convertToBytecode));
+	if (optionsAreValid && cacheIsUnused)
+	{
+		cout << "--cache can't be used with --interpret, --c or --bytecode, which translate nothing to keep" << endl;
+		optionsAreValid = false;
+	}
+	// --watch keeps linking the program of a folder until it is stopped
+	bool watchHasNoFolder = (watchForChanges && !inputIsDir);
+	bool watchNeverEnds = (watchForChanges && (!statsFileName.empty() || interpret || toC || compileOnly || convertToBytecode));
+	if (optionsAreValid && watchHasNoFolder)
+	{
+		cout << "--watch needs a folder to watch" << endl;
+		optionsAreValid = false;
+	}
+	else if (optionsAreValid && watchNeverEnds)
+	{
+		cout << "--watch keeps linking the program until it is stopped, so it can't be used with --stats, --interpret, --c, --compile or --bytecode" << endl;
+		optionsAreValid = false;
+	}
+	if (!optionsAreValid)
+	{
+		printUsage();
+		return 1;
+	}
+	// Object files hold assembly, and the pipeline writes it as it goes
+	bool toMachineCode = (outputFormat != OUTPUT_ASSEMBLY && !compileOnly);
+	if (toMachineCode) usePipeline = false;
+	// The pipeline parses and writes code at the same time, so its phases can't be told apart
+	unique_ptr<TranslationStats> stats;
+	if (!statsFileName.empty()) stats.reset(new TranslationStats());
+	translationStats = stats.get();
+	if (stats) usePipeline = false;
+	// Neither does the cache, which keeps whole object modules
+	if (!cacheFolder.empty()) usePipeline = false;
+	// The interpreter runs the parsed program as it is, so nothing is translated
+	// So does the C backend, which writes the whole program at once
+	bool parsesWholeProgram = (interpret || toC);
+	if (parsesWholeProgram) usePipeline = false;
+	bool outputWasWritten = true;
+	unique_ptr<TranslationCache> cache;
+	if (!cacheFolder.empty()) cache.reset(new TranslationCache(cacheFolder));
+	// A single file goes through the cache as a folder that holds only that file
+	bool inputIsCachedFile = (!inputIsDir && cache && fileIsVMFile(input));
+
+
+	if (inputIsDir || inputIsCachedFile)
+	{
+		vector<SourceFile> vmFiles;
+		if (inputIsCachedFile)
+		{
+			SourceFile file;
+			file.path = input;
+			file.name = fileNameOf(input);
+			file.size = 0;
+			vmFiles.push_back(file);
+		}
+		else
+		{
+			PhaseTimer timer(TranslationStats::PHASE_DISCOVERY);
+			vmFiles = discoverVMFiles(input);
+		}
+		bool thereAreVMFiles = (vmFiles.empty() == false);
+
+		if (convertToBytecode)
+		{
+			return writeBytecodeFiles(vmFiles) ? 0 : 1;
+		}
+		if (watchForChanges)
+		{
+			watchFolder(input, outputFormat, cache.get());
+			return 0;
+		}
+
+		if (parsesWholeProgram)
+		{
+			for (const SourceFile& file : vmFiles) parseModule(file.path, file.name, program);
+		}
+
+		vector<ObjectModule> objects;
+		if (thereAreVMFiles && !parsesWholeProgram) objects = compileFilesInParallel(vmFiles, cache.get(), toMachineCode);
+		if (thereAreVMFiles && !compileOnly && !parsesWholeProgram) outputWasWritten = linkModules(objects, false, outputFormat);
+		for (const ObjectModule& object : objects)
+		{
+			string objectFileName = withoutExtension(object.name) + ".vmo";
+			if (!compileOnly) continue;
+			bool objectWasWritten = saveObject(objectFileName, object);
+			cout << (objectWasWritten ? "Wrote " : "Could not write ") << objectFileName << endl;
+			if (!objectWasWritten) outputWasWritten = false;
+		}
+	}
+	// Input is file
+	else
+	{
+		if (fileIsVMFile(input) && convertToBytecode)
+		{
+			SourceFile file;
+			file.path = input;
+			file.name = fileNameOf(input);
+			file.size = 0;
+			outputWasWritten = writeBytecodeFiles(vector<SourceFile>(1, file));
+		}
+		else if (fileIsVMFile(input) && compileOnly)
+		{
+			Program fileProgram;
+			parseModule(input, fileNameOf(input), fileProgram);
+			ObjectModule object = compileModule(fileProgram, fileProgram.getModules()[0], true, false);
+			string objectFileName = withoutExtension(object.name) + ".vmo";
+			outputWasWritten = saveObject(objectFileName, object);
+			cout << (outputWasWritten ? "Wrote " : "Could not write ") << objectFileName << endl;
+		}
+		else if (fileIsVMFile(input) && usePipeline)
+		{
+			outputWasWritten = translateFilePipelined(input);
+		}
+		else if (fileIsVMFile(input))
+		{
+			parseModule(input, fileNameOf(input), program);
+		}
+		else
+		{
+			cout << input << " is neither a folder nor a VM file" << endl;
+			return 1;
+		}
+	}
+
+	/*
+		Translates the parsed file, one function per core, and links it, or runs the parsed files
+		on the VM interpreter, or translates them to C.
+	*/
+	bool thereAreModules = (program.getModules().empty() == false);
+	if (thereAreModules && interpret)
+	{
+		runOnInterpreter(program, program.getModules()[0].fileName);
+	}
+	else if (thereAreModules && toC)
+	{
+		outputWasWritten = writeCProgram(program);
+	}
+	else if (thereAreModules)
+	{
+		vector<ObjectModule> objects;
+		for (const Module& module : program.getModules())
+		{
+			objects.push_back(compileModule(program, module, true, toMachineCode));
+		}
+		outputWasWritten = linkModules(objects, false, outputFormat);
+	}
+
+	bool statsAreWritten = (stats && stats->writeJson(statsFileName));
+	if (statsAreWritten) cout << "Wrote the stats to " << statsFileName << endl;
+	return outputWasWritten ? 0 : 1;
+}
+
+// Main function methods
+void printUsage()
+{
+	cout << "Usage: VMTranslator <File.vm | folder> [--hack | --rom | --run | --interpret | --c | --compile | --bytecode]" << endl
+		<< "                    [--pipeline] [--watch] [--cache folder] [--stats file.json]" << endl
+		<< "       VMTranslator --stream [A.vm B.vm ...]    (text VM code only, in lines of up to 64 KB)" << endl
+		<< "       VMTranslator --link A.vmo B.vmo ..." << endl
+		<< "       VMTranslator --bench [lines] [seed] [runs]" << endl
+		<< "       VMTranslator --generate Name.vm [lines] [seed]" << endl
+		<< "       VMTranslator --cpu-bench [runs]" << endl
+		<< "       VMTranslator --vm-bench [runs]" << endl;
+}
+/*
+	What it does: Runs work(0) ... work(count - 1) on a pool of worker threads, one per core.
+
+	How it does it:
+
+	1. Starts one thread per core, but never more threads than items
+	2. Each thread claims the next item from a shared atomic counter and runs it, until the
+	   counter goes past the last item
+	3. Waits for all the threads to finish
+*/
+template <typename Work>
+void runInParallel(size_t count, Work work)
+{
+	size_t threadCount = max<size_t>(1, thread::hardware_concurrency());
+	threadCount = min(threadCount, count);
+
+	atomic<size_t> nextItem(0);
+	auto worker = [&]()
+	{
+		for (size_t item = nextItem++; item < count; item = nextItem++) work(item);
+	};
+
+	vector<thread> pool;
+	for (size_t i = 1; i < threadCount; i++) pool.emplace_back(worker);
+	worker();    // The calling thread works too
+	for (thread& poolThread : pool) poolThread.join();
+}
+/*
+	What it does: Translates every VM file of a folder into an object module of its own, using
+	              every core.
+
+	How it does it:
+
+	1. Reads the files on a thread of their own, largest first, while the rest of the threads
+	   take each file as soon as it has been read and:
+	2.   Load its object module from the cache, if there is one and the file is in it
+	3.   Otherwise parse it and translate it into an object module, which is stored in the
+	     cache if there is one
+*/
+vector<ObjectModule> compileFilesInParallel(const vector<SourceFile>& files, TranslationCache* cache, bool toMachineCode)
+{
+	size_t fileCount = files.size();
+	vector<ObjectModule> objects(fileCount);
+	atomic<size_t> modulesFromCache(0);
+
+	for (const SourceFile& file : files) cout << "Now Translating: " << file.path << endl;
+
+	vector<size_t> largestFirst(fileCount);
+	for (size_t i = 0; i < fileCount; i++) largestFirst[i] = i;
+	stable_sort(largestFirst.begin(), largestFirst.end(),
+		[&](size_t a, size_t b) { return files[a].size > files[b].size; });
+
+	// 1.
+	vector<string> filePaths(fileCount);
+	for (size_t k = 0; k < fileCount; k++) filePaths[k] = files[largestFirst[k]].path;
+	IngestedFileQueue ingestedFiles;
+	thread ingestionThread(ingestFiles, cref(filePaths), ref(ingestedFiles));
+
+	runInParallel(fileCount, [&](size_t)
+	{
+		IngestedFile file = ingestedFiles.pop();
+		size_t i = largestFirst[file.index];
+
+		// 2.
+		uint64_t cacheKey = 0;
+		if (cache != nullptr)
+		{
+			cacheKey = TranslationCache::keyOf(file.contents, files[i].name, toMachineCode);
+			bool moduleIsCached = (cache->load(cacheKey, objects[i]) && objects[i].name == files[i].name);
+			if (moduleIsCached)
+			{
+				modulesFromCache++;
+				return;
+			}
+		}
+
+		// 3.
+		Program program;
+		parseModule(move(file), files[i].name, program);
+		objects[i] = compileModule(program, program.getModules()[0], false, toMachineCode);
+		if (cache != nullptr) cache->store(cacheKey, objects[i]);
+	});
+	ingestionThread.join();
+
+	if (cache != nullptr) cout << "Took " << modulesFromCache << " of " << fileCount << " files from the cache" << endl;
+	return objects;
+}
+/*
+	What it does: Translates a module of a program into an object module.
+
+	How it does it:
+
+	1. Splits the module into parts: what comes before its first function, and then one part
+	   per function. Without functionsInParallel the whole module is a single part
+	2. Translates every part, in parallel, at address 0 into a buffer of its own, keeping where
+	   the ROM addresses are. No part depends on another one: the labels of a function only
+	   depend on its name, and every ROM address in it is relative to where it starts
+	3. Lays the parts out one after the other and joins them, adding to the ROM addresses of each
+	   part the address it starts at
+	4. Collects the functions it defines, the ones it calls and the static variables it uses
+	5. Imports are the functions it calls that it does not define
+*/
+ObjectModule compileModule(const Program& program, const Module& module, bool functionsInParallel, bool toMachineCode)
+{
+	ObjectModule object;
+	object.name = module.fileName;
+	const vector<Instruction>& instructions = program.getInstructions();
+	size_t endOfModule = module.firstInstruction + module.instructionCount;
+
+	// 1.
+	vector<Module> parts(1, module);
+	for (size_t i = module.firstInstruction + 1; functionsInParallel && i < endOfModule; i++)
+	{
+		if (instructions[i].opcode != OP_FUNCTION) continue;
+		parts.back().instructionCount = i - parts.back().firstInstruction;
+		parts.push_back(module);
+		parts.back().firstInstruction = i;
+		parts.back().instructionCount = endOfModule - i;
+	}
+
+	// 2.
+	size_t partCount = parts.size();
+	vector<string> partCode(partCount);
+	vector<vector<size_t>> partRelocations(partCount);
+	vector<int> partRomWords(partCount);
+	vector<MachineCode> partMachineCode(partCount);
+	runInParallel(partCount, [&](size_t k)
+	{
+		CodeWriter writer(&program.getSymbols());
+		writer.beginModule(module.fileName, 0);
+		writer.recordRomAddresses();
+		if (toMachineCode) writer.writeMachineCode();
+		translateModule(writer, program, parts[k]);
+		partRomWords[k] = writer.getWrittenInstructions();
+		partRelocations[k] = writer.takeRomAddressOffsets();
+		partCode[k] = writer.takeCode();
+		partMachineCode[k] = writer.takeMachineCode();
+	});
+
+	// 3.
+	if (partCount == 1)
+	{
+		object.romWords = partRomWords[0];
+		object.relocations = move(partRelocations[0]);
+		object.code = move(partCode[0]);
+		object.machineCode = move(partMachineCode[0]);
+	}
+	else if (toMachineCode)
+	{
+		vector<const MachineCode*> pieces;
+		for (const MachineCode& machineCode : partMachineCode) pieces.push_back(&machineCode);
+		object.machineCode = joinMachineCode(pieces);
+		object.romWords = (int)object.machineCode.words.size();
+	}
+	else
+	{
+		size_t codeLength = 0;
+		for (const string& code : partCode) codeLength += code.size();
+		object.code.reserve(codeLength + codeLength / 16);
+		object.romWords = 0;
+		for (size_t k = 0; k < partCount; k++)
+		{
+			appendRelocated(object.code, object.relocations, partCode[k], partRelocations[k], object.romWords);
+			object.romWords += partRomWords[k];
+			string().swap(partCode[k]);
+		}
+	}
+
+	// 4.
+	const SymbolTable& symbols = program.getSymbols();
+	string staticPrefix = withoutExtension(module.fileName) + ".";
+	set<string> definedFunctions, calledFunctions, staticVariables;
+	for (size_t i = module.firstInstruction; i < endOfModule; i++)
+	{
+		const Instruction& instruction = instructions[i];
+		bool instructionUsesStatic = ((instruction.opcode == OP_PUSH || instruction.opcode == OP_POP) &&
+			segmentTable[instruction.segment].access == ACCESS_STATIC);
+
+		if (instruction.opcode == OP_FUNCTION) definedFunctions.insert(symbols.nameOf(instruction.symbol));
+		else if (instruction.opcode == OP_CALL) calledFunctions.insert(symbols.nameOf(instruction.symbol));
+		else if (instructionUsesStatic) staticVariables.insert(staticPrefix + to_string(instruction.index));
+	}
+
+	// 5.
+	object.exports.assign(definedFunctions.begin(), definedFunctions.end());
+	for (const string& function : calledFunctions)
+	{
+		if (definedFunctions.count(function) == 0) object.imports.push_back(function);
+	}
+	object.statics.assign(staticVariables.begin(), staticVariables.end());
+	return object;
+}
+/*
+	What it does: Appends code translated on its own to the received code, adding the received
+	              amount to every ROM address in it, and records where those addresses end up.
+*/
+void appendRelocated(string& code, vector<size_t>& relocations, string_view partCode,
+	const vector<size_t>& partRelocations, int addend)
+{
+	size_t copiedSoFar = 0;
+	for (size_t offset : partRelocations)
+	{
+		int address = 0;
+		const char* endOfAddress = from_chars(partCode.data() + offset, partCode.data() + partCode.size(), address).ptr;
+		code.append(partCode.data() + copiedSoFar, offset - copiedSoFar);
+
+		relocations.push_back(code.size());
+		char digits[16];
+		char* endOfDigits = to_chars(digits, digits + sizeof(digits), address + addend).ptr;
+		code.append(digits, endOfDigits - digits);
+		copiedSoFar = endOfAddress - partCode.data();
+	}
+	code.append(partCode.data() + copiedSoFar, partCode.size() - copiedSoFar);
+}
+/*
+	What it does: Joins pieces of machine code translated on their own into one that starts at
+	              address 0, each piece moved to the address where the previous one ends.
+
+	How it does it: For each piece:
+	                1. Gives each of its symbols the id the joined code has for the same name,
+					   so every name is compared once, not once per reference
+					2. Appends its words, adding to the ROM addresses the address it starts at
+					3. Appends its references and definitions, with the new ids and addresses
+*/
+MachineCode joinMachineCode(const vector<const MachineCode*>& pieces)
+{
+	MachineCode code;
+	unordered_map<string_view, int> symbolIds;    // views into the names of the pieces
+	vector<int> joinedSymbolOf;
+	for (const MachineCode* piece : pieces)
+	{
+		// 1.
+		joinedSymbolOf.resize(piece->symbols.size());
+		for (size_t id = 0; id < piece->symbols.size(); id++)
+		{
+			auto symbol = symbolIds.emplace(piece->symbols[id], (int)code.symbols.size());
+			bool symbolIsNew = symbol.second;
+			if (symbolIsNew) code.symbols.push_back(piece->symbols[id]);
+			joinedSymbolOf[id] = symbol.first->second;
+		}
+
+		// 2.
+		size_t firstWord = code.words.size();
+		code.words.insert(code.words.end(), piece->words.begin(), piece->words.end());
+		for (size_t word : piece->relocations)
+		{
+			code.words[firstWord + word] += (uint16_t)firstWord;
+			code.relocations.push_back(firstWord + word);
+		}
+
+		// 3.
+		for (const SymbolReference& reference : piece->references)
+		{
+			code.references.push_back({ firstWord + reference.word, joinedSymbolOf[reference.symbol] });
+		}
+		for (const SymbolDefinition& definition : piece->definitions)
+		{
+			code.definitions.push_back({ joinedSymbolOf[definition.symbol], definition.address + (int)firstWord });
+		}
+	}
+	return code;
+}
+/*
+	What it does: Joins object modules into a single assembly file.
+
+	How it does it:
+
+	1. Checks the symbols of the modules against each other and reports what does not fit.
+	   Calls to functions no module defines are only reported if asked to, since a program
+	   usually calls the operating system without linking it in
+	2. Opens the output, named after the first module, and writes the preamble. Machine code is
+	   assembled into a program instead
+	3. Writes every module, in order, at the address where the previous one ends
+*/
+bool linkModules(const vector<ObjectModule>& objects, bool reportUndefinedCalls, OutputFormat outputFormat)
+{
+	PhaseTimer timer(TranslationStats::PHASE_OUTPUT);
+
+	// 1.
+	unordered_map<string, string> definitions;
+	set<string> moduleNames;
+	for (const ObjectModule& object : objects)
+	{
+		for (const string& function : object.exports)
+		{
+			bool functionIsDefinedTwice = (definitions.emplace(function, object.name).second == false);
+			if (functionIsDefinedTwice)
+			{
+				cout << "Warning: " << function << " is defined in both " << definitions[function]
+					<< " and " << object.name << endl;
+			}
+		}
+		string moduleName = withoutExtension(object.name);
+		bool staticsClash = (moduleNames.insert(moduleName).second == false && !object.statics.empty());
+		if (staticsClash) cout << "Warning: more than one module shares the static variables of " << moduleName << endl;
+	}
+	for (const ObjectModule& object : objects)
+	{
+		for (const string& function : object.imports)
+		{
+			bool functionIsUndefined = (reportUndefinedCalls && definitions.count(function) == 0);
+			if (functionIsUndefined) cout << "Warning: " << object.name << " calls " << function << ", which no module defines" << endl;
+		}
+	}
+
+	// 2.
+	if (outputFormat != OUTPUT_ASSEMBLY)
+	{
+		return assembleModules(objects, outputFormat);
+	}
+	CodeWriter writer;
+	writer.initialize(objects[0].name, 0);
+
+	// 3.
+	int nextAddress = writer.getWrittenInstructions();
+	for (const ObjectModule& object : objects)
+	{
+		writeRelocated(writer, object, nextAddress);
+		nextAddress += object.romWords;
+	}
+	bool programWasWritten = writer.finish();
+	if (programWasWritten) reportWrittenProgram(writer.getOutputFileName(), writer.getBytesWritten(), writer.getFlushCount(), nextAddress);
+	else cout << "Could not write " << writer.getOutputFileName() << endl;
+	return programWasWritten;
+}
+/*
+	What it does: Joins object modules translated to machine code into a single HACK program,
+	              named after the first one, with the preamble in front, and writes it as .hack
+				  text or as a raw binary ROM image (.bin), or runs it on the emulator.
+
+	How it does it: Assembles the program, and writes every word as a line of 16 '0' and '1'
+	                characters, or as two bytes, the most significant first.
+*/
+bool assembleModules(const vector<ObjectModule>& objects, OutputFormat outputFormat)
+{
+	HackProgram program = assembleProgram(objects);
+	if (outputFormat == OUTPUT_EMULATION)
+	{
+		runOnEmulator(program, objects[0].name);
+		return true;
+	}
+
+	bool writesBinary = (outputFormat == OUTPUT_HACK_BINARY);
+	string outputFileName = withoutExtension(objects[0].name) + (writesBinary ? ".bin" : ".hack");
+	FileSink outputFile;
+	if (!outputFile.open(outputFileName))
+	{
+		cout << "Could not write " << outputFileName << endl;
+		return false;
+	}
+	AssemblyBuffer machineCode;
+	machineCode.setSink(&outputFile);
+	for (uint16_t word : program.words)
+	{
+		char bytes[17];
+		if (writesBinary)
+		{
+			bytes[0] = (char)(word >> 8);
+			bytes[1] = (char)(word & 0xFF);
+			machineCode.append(bytes, 2);
+			continue;
+		}
+		for (int bit = 0; bit < 16; bit++) bytes[bit] = (char)('0' + ((word >> (15 - bit)) & 1));
+		bytes[16] = '\n';
+		machineCode.append(bytes, 17);
+	}
+	machineCode.flush();
+	bool programWasWritten = outputFile.close();
+	if (programWasWritten) reportWrittenProgram(outputFileName, machineCode.getBytesWritten(), machineCode.getFlushCount(), (int)program.words.size());
+	else cout << "Could not write " << outputFileName << endl;
+	return programWasWritten;
+}
+/*
+	What it does: Joins object modules translated to machine code into a single HACK program,
+	              with the preamble in front, and resolves every symbol in it.
+
+	How it does it:
+
+	1. Encodes the preamble, and appends the machine code of every module after it, in order
+	2. Gives every label declared in the program its address. A label declared more than once
+	   keeps the first one. The labels that are functions some module exports are the
+	   functions of the program
+	3. Gives every other symbol the next free RAM address from 16 on, in the order the symbols
+	   first appear, which is what the HACK assembler does with variables
+*/
+HackProgram assembleProgram(const vector<ObjectModule>& objects)
+{
+	// 1.
+	CodeWriter writer;
+	writer.writeMachineCode();
+	writer.initialize(objects[0].name, 0);
+	MachineCode preamble = writer.takeMachineCode();
+	vector<const MachineCode*> pieces(1, &preamble);
+	for (const ObjectModule& object : objects) pieces.push_back(&object.machineCode);
+	MachineCode program = joinMachineCode(pieces);
+	HackProgram hackProgram;
+
+	// 2.
+	set<string_view> functionNames;
+	for (const ObjectModule& object : objects) functionNames.insert(object.exports.begin(), object.exports.end());
+	vector<int> symbolValues(program.symbols.size(), -1);
+	for (const SymbolDefinition& definition : program.definitions)
+	{
+		bool symbolIsUndeclared = (symbolValues[definition.symbol] < 0);
+		if (!symbolIsUndeclared) continue;
+		symbolValues[definition.symbol] = definition.address;
+		const string& name = program.symbols[definition.symbol];
+		if (functionNames.count(name) != 0) hackProgram.functions.emplace_back(definition.address, name);
+	}
+	sort(hackProgram.functions.begin(), hackProgram.functions.end());
+
+	// 3.
+	int nextVariable = 16;
+	for (const SymbolReference& reference : program.references)
+	{
+		int& value = symbolValues[reference.symbol];
+		if (value < 0) value = nextVariable++;
+		program.words[reference.word] = (uint16_t)value;
+	}
+	hackProgram.words = move(program.words);
+	return hackProgram;
+}
+/*
+	What it does: Runs a program on the HACK CPU emulator and reports what it took.
+
+	How it does it:
+
+	1. Refuses a program that does not fit in the ROM, since its addresses can't be reached
+	2. Runs it, and reports how it stopped, the cycles it took and how fast it ran
+	3. Adds up the cycles of the code of every function, from its first address to where the
+	   next function starts. The code before the first function, the preamble with the routine
+	   every comparison jumps to among it, is outside any function. A function is called as many
+	   times as its first instruction runs
+	4. Reports the functions that took the most cycles, and what each call and return takes,
+	   since both run straight through
+*/
+void runOnEmulator(const HackProgram& program, const string& programName)
+{
+	// 1.
+	int romWords = (int)program.words.size();
+	if (romWords > hackRomWords)
+	{
+		cout << programName << " takes " << romWords << " ROM words and does not fit in the " << hackRomWords
+			<< " words of the HACK ROM, so it can't be run" << endl;
+		return;
+	}
+
+	// 2.
+	HackEmulator emulator(program.words);
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	emulator.run(emulatorCycleLimit);
+	chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+	uint64_t cycles = emulator.getCycles();
+
+	const char* howItStopped = "halted";
+	if (emulator.getStopReason() == HackEmulator::STOP_CYCLE_LIMIT) howItStopped = "was stopped without halting";
+	else if (emulator.getStopReason() == HackEmulator::STOP_END_OF_ROM) howItStopped = "ran past the end of its code";
+	cout << "Ran " << programName << " on the HACK CPU emulator. It " << howItStopped << " after " << cycles
+		<< " cycles (" << fixed << setprecision(1) << cycles / max(elapsed.count(), 1e-9) / 1e6 << " M cycles/s)" << endl;
+	cout << "ROM words: " << romWords << ". Deepest stack: " << emulator.getLargestStackDepth() << " words" << endl;
+
+	// 3.
+	struct FunctionCycles
+	{
+		string name;
+		uint64_t cycles;
+		uint64_t calls;
+		int romWords;
+	};
+	const vector<uint64_t>& addressCycles = emulator.getAddressCycles();
+	vector<FunctionCycles> functions;
+	int preambleEnd = (program.functions.empty() ? romWords : program.functions[0].first);
+	functions.push_back({ "(outside functions)", 0, 0, preambleEnd });
+	for (size_t k = 0; k < program.functions.size(); k++)
+	{
+		int first = program.functions[k].first;
+		int end = (k + 1 < program.functions.size() ? program.functions[k + 1].first : romWords);
+		functions.push_back({ program.functions[k].second, 0, addressCycles[first], end - first });
+	}
+	uint64_t calls = 0;
+	for (size_t k = 0; k < functions.size(); k++)
+	{
+		int first = (k == 0 ? 0 : program.functions[k - 1].first);
+		for (int address = first; address < first + functions[k].romWords; address++) functions[k].cycles += addressCycles[address];
+		calls += functions[k].calls;
+	}
+
+	// 4.
+	stable_sort(functions.begin(), functions.end(),
+		[](const FunctionCycles& a, const FunctionCycles& b) { return a.cycles > b.cycles; });
+	cout << "Calls: " << calls << ". Each call runs " << CodeWriter::getCallRomWords()
+		<< " instructions before the function starts, and each return " << CodeWriter::getReturnRomWords() << endl;
+	cout << "Cycles in the code of each function, without the functions it calls:" << endl;
+	const size_t functionsReported = 20;
+	for (size_t k = 0; k < functions.size() && k < functionsReported; k++)
+	{
+		const FunctionCycles& function = functions[k];
+		cout << "  " << left << setw(32) << function.name << right << setw(14) << function.cycles << " cycles "
+			<< setprecision(1) << setw(5) << 100.0 * function.cycles / max<uint64_t>(cycles, 1) << "%" << setw(10)
+			<< function.calls << " calls" << setw(8) << function.romWords << " ROM words" << endl;
+	}
+	if (functions.size() > functionsReported) cout << "  ... and " << functions.size() - functionsReported << " more" << endl;
+}
+/*
+	Functionality: The VM programs the emulator benchmark runs, with the result each leaves in
+	               temp 7 (R12). Each one stresses a different part of the generated code:
+				   calls and returns, loops and labels, the that segment, and arguments.
+*/
+struct EmulatorBenchmark
+{
+	const char* name;
+	const char* vmCode;
+	int16_t result;
+};
+const EmulatorBenchmark emulatorBenchmarks[] =
+{
+	{ "Fibonacci",
+		"function Sys.init 0\n"
+		"push constant 22\n"
+		"call Main.fibonacci 1\n"
+		"pop temp 7\n"
+		"label HALT\n"
+		"goto HALT\n"
+		"function Main.fibonacci 0\n"
+		"push argument 0\n"
+		"push constant 2\n"
+		"lt\n"
+		"if-goto BASE\n"
+		"push argument 0\n"
+		"push constant 2\n"
+		"sub\n"
+		"call Main.fibonacci 1\n"
+		"push argument 0\n"
+		"push constant 1\n"
+		"sub\n"
+		"call Main.fibonacci 1\n"
+		"add\n"
+		"return\n"
+		"label BASE\n"
+		"push argument 0\n"
+		"return\n",
+		17711 },
+	{ "Loops",
+		"function Sys.init 0\n"
+		"call Main.loops 0\n"
+		"pop temp 7\n"
+		"label HALT\n"
+		"goto HALT\n"
+		"function Main.loops 3\n"
+		"label OUTER\n"
+		"push local 0\n"
+		"push constant 300\n"
+		"lt\n"
+		"not\n"
+		"if-goto DONE\n"
+		"push constant 0\n"
+		"pop local 1\n"
+		"label INNER\n"
+		"push local 1\n"
+		"push constant 100\n"
+		"lt\n"
+		"not\n"
+		"if-goto NEXT\n"
+		"push local 2\n"
+		"push local 0\n"
+		"add\n"
+		"push local 1\n"
+		"sub\n"
+		"pop local 2\n"
+		"push local 1\n"
+		"push constant 1\n"
+		"add\n"
+		"pop local 1\n"
+		"goto INNER\n"
+		"label NEXT\n"
+		"push local 0\n"
+		"push constant 1\n"
+		"add\n"
+		"pop local 0\n"
+		"goto OUTER\n"
+		"label DONE\n"
+		"push local 2\n"
+		"return\n",
+		-14656 },
+	{ "BubbleSort",
+		"function Sys.init 0\n"
+		"push constant 60\n"
+		"call Main.sort 1\n"
+		"pop temp 7\n"
+		"label HALT\n"
+		"goto HALT\n"
+		"function Main.sort 4\n"
+		"label FILL\n"
+		"push local 0\n"
+		"push argument 0\n"
+		"lt\n"
+		"not\n"
+		"if-goto SORT\n"
+		"push constant 2048\n"
+		"push local 0\n"
+		"add\n"
+		"pop pointer 1\n"
+		"push local 2\n"
+		"push constant 37\n"
+		"add\n"
+		"push constant 127\n"
+		"and\n"
+		"pop local 2\n"
+		"push local 2\n"
+		"pop that 0\n"
+		"push local 0\n"
+		"push constant 1\n"
+		"add\n"
+		"pop local 0\n"
+		"goto FILL\n"
+		"label SORT\n"
+		"push local 3\n"
+		"push argument 0\n"
+		"lt\n"
+		"not\n"
+		"if-goto DONE\n"
+		"push constant 0\n"
+		"pop local 0\n"
+		"label PASS\n"
+		"push local 0\n"
+		"push argument 0\n"
+		"push constant 1\n"
+		"sub\n"
+		"lt\n"
+		"not\n"
+		"if-goto NEXTPASS\n"
+		"push constant 2048\n"
+		"push local 0\n"
+		"add\n"
+		"pop pointer 1\n"
+		"push that 0\n"
+		"push that 1\n"
+		"gt\n"
+		"not\n"
+		"if-goto NOSWAP\n"
+		"push that 0\n"
+		"pop local 2\n"
+		"push that 1\n"
+		"pop that 0\n"
+		"push local 2\n"
+		"pop that 1\n"
+		"push local 1\n"
+		"push constant 1\n"
+		"add\n"
+		"pop local 1\n"
+		"label NOSWAP\n"
+		"push local 0\n"
+		"push constant 1\n"
+		"add\n"
+		"pop local 0\n"
+		"goto PASS\n"
+		"label NEXTPASS\n"
+		"push local 3\n"
+		"push constant 1\n"
+		"add\n"
+		"pop local 3\n"
+		"goto SORT\n"
+		"label DONE\n"
+		"push local 1\n"
+		"return\n",
+		880 },
+	{ "Multiply",
+		"function Sys.init 0\n"
+		"call Main.products 0\n"
+		"pop temp 7\n"
+		"label HALT\n"
+		"goto HALT\n"
+		"function Main.multiply 3\n"
+		"push argument 0\n"
+		"pop local 1\n"
+		"push constant 1\n"
+		"pop local 2\n"
+		"label LOOP\n"
+		"push local 2\n"
+		"push constant 0\n"
+		"eq\n"
+		"if-goto DONE\n"
+		"push argument 1\n"
+		"push local 2\n"
+		"and\n"
+		"push constant 0\n"
+		"eq\n"
+		"if-goto SKIP\n"
+		"push local 0\n"
+		"push local 1\n"
+		"add\n"
+		"pop local 0\n"
+		"label SKIP\n"
+		"push local 1\n"
+		"push local 1\n"
+		"add\n"
+		"pop local 1\n"
+		"push local 2\n"
+		"push local 2\n"
+		"add\n"
+		"pop local 2\n"
+		"goto LOOP\n"
+		"label DONE\n"
+		"push local 0\n"
+		"return\n"
+		"function Main.products 2\n"
+		"label LOOP\n"
+		"push local 0\n"
+		"push constant 200\n"
+		"lt\n"
+		"not\n"
+		"if-goto DONE\n"
+		"push local 1\n"
+		"push local 0\n"
+		"push local 0\n"
+		"push constant 3\n"
+		"add\n"
+		"call Main.multiply 2\n"
+		"add\n"
+		"pop local 1\n"
+		"push local 0\n"
+		"push constant 1\n"
+		"add\n"
+		"pop local 0\n"
+		"goto LOOP\n"
+		"label DONE\n"
+		"push local 1\n"
+		"return\n",
+		19424 }
+};
+/*
+	What it does: Runs the fixed set of VM programs on the HACK CPU emulator.
+
+	How it does it: For each program:
+
+	1. Translates it to machine code in memory, with its functions in parallel
+	2. Runs it the received number of times, each on a new emulator, keeping the fastest run
+	3. Reports its ROM words, cycles, deepest stack and calls, whether it halted with the right
+	   result in temp 7, and the speed of the emulator in its fastest run
+*/
+void runEmulatorBenchmark(int runs)
+{
+	cout << left << setw(12) << "Program" << right << setw(10) << "ROM words" << setw(14) << "Cycles"
+		<< setw(8) << "Stack" << setw(10) << "Calls" << setw(8) << "Result" << setw(16) << "M cycles/s" << endl;
+	for (const EmulatorBenchmark& benchmark : emulatorBenchmarks)
+	{
+		// 1.
+		Program program;
+		parseModule(IngestedFile{ 0, benchmark.vmCode }, "Main.vm", program);
+		vector<ObjectModule> objects;
+		objects.push_back(compileModule(program, program.getModules()[0], true, true));
+		HackProgram hackProgram = assembleProgram(objects);
+
+		// 2.
+		double fastestRun = 0;
+		unique_ptr<HackEmulator> emulator;
+		for (int run = 0; run < runs; run++)
+		{
+			emulator.reset(new HackEmulator(hackProgram.words));
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			emulator->run(emulatorCycleLimit);
+			chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+			if (run == 0 || elapsed.count() < fastestRun) fastestRun = elapsed.count();
+		}
+
+		// 3.
+		uint64_t calls = 0;
+		for (const pair<int, string>& function : hackProgram.functions) calls += emulator->getAddressCycles()[function.first];
+		bool resultIsRight = (emulator->getStopReason() == HackEmulator::STOP_HALTED && emulator->getRam(12) == benchmark.result);
+		cout << left << setw(12) << benchmark.name << right << setw(10) << hackProgram.words.size() << setw(14)
+			<< emulator->getCycles() << setw(8) << emulator->getLargestStackDepth() << setw(10) << calls << setw(8)
+			<< (resultIsRight ? "right" : "WRONG") << setw(16) << fixed << setprecision(1)
+			<< emulator->getCycles() / max(fastestRun, 1e-9) / 1e6 << endl;
+	}
+}
+/*
+	What it does: Runs a program on the VM interpreter and reports what it did.
+
+	How it does it: Decodes the program, runs it, and reports how it stopped, the instructions,
+	                calls and time it took, and the eight words of temp.
+*/
+void runOnInterpreter(const Program& program, const string& programName)
+{
+	VMInterpreter interpreter(program);
+	if (!interpreter.callsSysInit()) cout << programName << " has no Sys.init, so it is run from its first instruction" << endl;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	interpreter.run(interpreterInstructionLimit);
+	chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+	uint64_t instructions = interpreter.getInstructions();
+
+	const char* howItStopped = "halted";
+	if (interpreter.getStopReason() == VMInterpreter::STOP_INSTRUCTION_LIMIT) howItStopped = "was stopped without halting";
+	else if (interpreter.getStopReason() == VMInterpreter::STOP_END_OF_CODE) howItStopped = "ran past the end of its code";
+	else if (interpreter.getStopReason() == VMInterpreter::STOP_UNDEFINED_SYMBOL) howItStopped = "went to a label or function nobody declares";
+	cout << "Ran " << programName << " on the VM interpreter. It " << howItStopped << " after " << instructions
+		<< " VM instructions and " << interpreter.getCalls() << " calls, in " << fixed << setprecision(3)
+		<< elapsed.count() * 1000 << " ms (" << setprecision(1) << instructions / max(elapsed.count(), 1e-9) / 1e6
+		<< " M instructions/s)" << endl;
+	cout << "Temp:";
+	for (int address = 5; address <= 12; address++) cout << " " << interpreter.getRam(address);
+	cout << endl;
+}
+/*
+	What it does: Runs the programs of the emulator benchmark on the VM interpreter and on the
+	              HACK CPU emulator.
+
+	How it does it: For each program:
+
+	1. Parses it, and translates it to machine code in memory
+	2. Runs it the received number of times on each, each time on a new interpreter or emulator,
+	   keeping the fastest run of each
+	3. Reports the VM instructions and calls it ran, whether both halted with the right result
+	   in temp 7, the speed of the interpreter and how many times faster than the emulator it was
+*/
+void runInterpreterBenchmark(int runs)
+{
+	cout << left << setw(12) << "Program" << right << setw(14) << "Instructions" << setw(10) << "Calls" << setw(8)
+		<< "Result" << setw(18) << "M instructions/s" << setw(14) << "Emulator ms" << setw(16) << "Interpreter ms"
+		<< setw(10) << "Speedup" << endl;
+	for (const EmulatorBenchmark& benchmark : emulatorBenchmarks)
+	{
+		// 1.
+		Program program;
+		parseModule(IngestedFile{ 0, benchmark.vmCode }, "Main.vm", program);
+		vector<ObjectModule> objects;
+		objects.push_back(compileModule(program, program.getModules()[0], true, true));
+		HackProgram hackProgram = assembleProgram(objects);
+
+		// 2.
+		double fastestInterpretation = 0;
+		double fastestEmulation = 0;
+		unique_ptr<VMInterpreter> interpreter;
+		unique_ptr<HackEmulator> emulator;
+		for (int run = 0; run < runs; run++)
+		{
+			interpreter.reset(new VMInterpreter(program));
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			interpreter->run(interpreterInstructionLimit);
+			chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+			if (run == 0 || elapsed.count() < fastestInterpretation) fastestInterpretation = elapsed.count();
+
+			emulator.reset(new HackEmulator(hackProgram.words));
+			start = chrono::steady_clock::now();
+			emulator->run(emulatorCycleLimit);
+			elapsed = chrono::steady_clock::now() - start;
+			if (run == 0 || elapsed.count() < fastestEmulation) fastestEmulation = elapsed.count();
+		}
+
+		// 3.
+		bool interpreterIsRight = (interpreter->getStopReason() == VMInterpreter::STOP_HALTED && interpreter->getRam(12) == benchmark.result);
+		bool emulatorIsRight = (emulator->getStopReason() == HackEmulator::STOP_HALTED && emulator->getRam(12) == benchmark.result);
+		cout << left << setw(12) << benchmark.name << right << setw(14) << interpreter->getInstructions() << setw(10)
+			<< interpreter->getCalls() << setw(8) << (interpreterIsRight && emulatorIsRight ? "right" : "WRONG") << setw(18)
+			<< fixed << setprecision(1) << interpreter->getInstructions() / max(fastestInterpretation, 1e-9) / 1e6
+			<< setw(14) << setprecision(3) << fastestEmulation * 1000 << setw(16) << fastestInterpretation * 1000
+			<< setw(9) << setprecision(1) << fastestEmulation / max(fastestInterpretation, 1e-9) << "x" << endl;
+	}
+}
+/*
+	What it does: Writes the code of an object module through the writer, moved so it starts at
+	              the received ROM address.
+
+	How it does it: Copies the code, replacing every ROM address in it with the same address
+	                plus the one the module starts at.
+*/
+void writeRelocated(CodeWriter& writer, const ObjectModule& object, int firstAddress)
+{
+	string_view code = object.code;
+	size_t copiedSoFar = 0;
+	for (size_t offset : object.relocations)
+	{
+		int address = 0;
+		const char* endOfAddress = from_chars(code.data() + offset, code.data() + code.size(), address).ptr;
+		writer.writeCode(code.substr(copiedSoFar, offset - copiedSoFar));
+
+		char digits[16];
+		char* endOfDigits = to_chars(digits, digits + sizeof(digits), address + firstAddress).ptr;
+		writer.writeCode(string_view(digits, endOfDigits - digits));
+		copiedSoFar = endOfAddress - code.data();
+	}
+	writer.writeCode(code.substr(copiedSoFar));
+}
+void reportWrittenProgram(const string& fileName, size_t bytesWritten, int flushCount, int romWords)
+{
+	cout << "Wrote " << bytesWritten << " bytes to " << fileName << " in " << flushCount
+		<< " flushes. The program takes " << romWords << " ROM words" << endl;
+
+	if (translationStats != nullptr) translationStats->addOutput(bytesWritten, romWords);
+	bool programDoesNotFit = (romWords > hackRomWords);
+	if (programDoesNotFit) cout << "Warning: the program does not fit in the " << hackRomWords << " words of the HACK ROM" << endl;
+}
+string serializeObject(const ObjectModule& object)
+{
+	const MachineCode& machineCode = object.machineCode;
+	string bytes = "VMO 2\n" + object.name + '\n';
+	bytes += to_string(object.romWords) + ' ' + to_string(object.exports.size()) + ' ' +
+		to_string(object.imports.size()) + ' ' + to_string(object.statics.size()) + ' ' +
+		to_string(object.relocations.size()) + ' ' + to_string(object.code.size()) + '\n';
+	for (const string& function : object.exports) bytes += function + '\n';
+	for (const string& function : object.imports) bytes += function + '\n';
+	for (const string& variable : object.statics) bytes += variable + '\n';
+	for (size_t offset : object.relocations) bytes += to_string(offset) + '\n';
+	bytes += to_string(machineCode.words.size()) + ' ' + to_string(machineCode.relocations.size()) + ' ' +
+		to_string(machineCode.symbols.size()) + ' ' + to_string(machineCode.references.size()) + ' ' +
+		to_string(machineCode.definitions.size()) + '\n';
+	for (uint16_t word : machineCode.words) bytes += to_string(word) + '\n';
+	for (size_t offset : machineCode.relocations) bytes += to_string(offset) + '\n';
+	for (const string& symbol : machineCode.symbols) bytes += symbol + '\n';
+	for (const SymbolReference& reference : machineCode.references)
+		bytes += to_string(reference.word) + ' ' + to_string(reference.symbol) + '\n';
+	for (const SymbolDefinition& definition : machineCode.definitions)
+		bytes += to_string(definition.symbol) + ' ' + to_string(definition.address) + '\n';
+	bytes += object.code;
+	return bytes;
+}
+/*
+	What it does: Reads an object module back from its bytes. Returns false if they are not a
+	              complete object in the current format.
+*/
+bool deserializeObject(string_view bytes, ObjectModule& object)
+{
+	auto nextLine = [&]()
+	{
+		size_t endOfLine = bytes.find('\n');
+		if (endOfLine == string_view::npos) endOfLine = bytes.size();
+		string_view line = bytes.substr(0, endOfLine);
+		bytes.remove_prefix(min(endOfLine + 1, bytes.size()));
+		return line;
+	};
+	auto nextNumber = [](string_view& line, size_t& number)
+	{
+		auto result = from_chars(line.data(), line.data() + line.size(), number);
+		if (result.ec != errc()) return false;
+		line.remove_prefix(min<size_t>(result.ptr - line.data() + 1, line.size()));
+		return true;
+	};
+	auto nextNames = [&](size_t count, vector<string>& names)
+	{
+		names.clear();
+		for (size_t i = 0; i < count; i++) names.emplace_back(nextLine());
+	};
+
+	string_view format = nextLine();
+	bool formatIsKnown = (format == "VMO 1" || format == "VMO 2");
+	if (!formatIsKnown) return false;
+	object.name.assign(nextLine());
+	string_view counts = nextLine();
+	size_t romWords, exportCount, importCount, staticCount, relocationCount, codeLength;
+	bool countsAreValid = (nextNumber(counts, romWords) && nextNumber(counts, exportCount) &&
+		nextNumber(counts, importCount) && nextNumber(counts, staticCount) &&
+		nextNumber(counts, relocationCount) && nextNumber(counts, codeLength));
+	if (!countsAreValid) return false;
+
+	object.romWords = (int)romWords;
+	nextNames(exportCount, object.exports);
+	nextNames(importCount, object.imports);
+	nextNames(staticCount, object.statics);
+	object.relocations.resize(relocationCount);
+	for (size_t i = 0; i < relocationCount; i++)
+	{
+		string_view line = nextLine();
+		if (!nextNumber(line, object.relocations[i])) return false;
+	}
+
+	MachineCode& machineCode = object.machineCode;
+	machineCode = MachineCode();
+	if (format == "VMO 2")
+	{
+		string_view machineCounts = nextLine();
+		size_t wordCount, machineRelocationCount, symbolCount, referenceCount, definitionCount;
+		bool machineCountsAreValid = (nextNumber(machineCounts, wordCount) && nextNumber(machineCounts, machineRelocationCount) &&
+			nextNumber(machineCounts, symbolCount) && nextNumber(machineCounts, referenceCount) &&
+			nextNumber(machineCounts, definitionCount));
+		if (!machineCountsAreValid) return false;
+
+		size_t number, symbol;
+		for (size_t i = 0; i < wordCount; i++)
+		{
+			string_view line = nextLine();
+			bool wordIsValid = (nextNumber(line, number) && number <= 0xFFFF);
+			if (!wordIsValid) return false;
+			machineCode.words.push_back((uint16_t)number);
+		}
+		for (size_t i = 0; i < machineRelocationCount; i++)
+		{
+			string_view line = nextLine();
+			bool offsetIsValid = (nextNumber(line, number) && number < wordCount);
+			if (!offsetIsValid) return false;
+			machineCode.relocations.push_back(number);
+		}
+		nextNames(symbolCount, machineCode.symbols);
+		for (size_t i = 0; i < referenceCount; i++)
+		{
+			string_view line = nextLine();
+			bool referenceIsValid = (nextNumber(line, number) && nextNumber(line, symbol) &&
+				number < wordCount && symbol < symbolCount);
+			if (!referenceIsValid) return false;
+			machineCode.references.push_back({ number, (int)symbol });
+		}
+		for (size_t i = 0; i < definitionCount; i++)
+		{
+			string_view line = nextLine();
+			bool definitionIsValid = (nextNumber(line, symbol) && nextNumber(line, number) &&
+				symbol < symbolCount && number <= INT_MAX);
+			if (!definitionIsValid) return false;
+			machineCode.definitions.push_back({ (int)symbol, (int)number });
+		}
+	}
+
+	bool objectIsComplete = (bytes.size() == codeLength);
+	if (!objectIsComplete) return false;
+	object.code.assign(bytes);
+	size_t previousOffset = 0;
+	for (size_t offset : object.relocations)
+	{
+		bool offsetIsValid = (offset < object.code.size() && offset >= previousOffset);
+		if (!offsetIsValid) return false;
+		previousOffset = offset + 1;
+	}
+	return true;
+}
+bool loadObject(const string& fileName, ObjectModule& object)
+{
+	string bytes;
+	if (!readWholeFile(fileName, bytes)) return false;
+	return deserializeObject(bytes, object);
+}
+bool saveObject(const string& fileName, const ObjectModule& object)
+{
+	return writeWholeFile(fileName, serializeObject(object));
+}
+bool writeWholeFile(const string& fileName, string_view bytes)
+{
+	string temporaryFileName = fileName + "." + to_string(hash<thread::id>()(this_thread::get_id())) + ".tmp";
+	FILE* file = fopen(temporaryFileName.c_str(), "wb");
+	if (file == nullptr) return false;
+	bool fileWasWritten = (fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size());
+	fileWasWritten = (fclose(file) == 0 && fileWasWritten);
+#ifdef _WIN32
+	if (fileWasWritten) remove(fileName.c_str());
+#endif
+	if (fileWasWritten && rename(temporaryFileName.c_str(), fileName.c_str()) == 0) return true;
+	remove(temporaryFileName.c_str());
+	return false;
+}
+/*
+	What it does: Encodes a module of a program in the binary form.
+
+	How it does it:
+
+	1. Gives every label and function name the module uses a position in its string table,
+	   in the order they first appear
+	2. Writes the header and the string table
+	3. Writes every instruction with the fields its command type carries
+*/
+string encodeBytecode(const Program& program, const Module& module)
+{
+	const vector<Instruction>& instructions = program.getInstructions();
+	const SymbolTable& symbols = program.getSymbols();
+	size_t endOfModule = module.firstInstruction + module.instructionCount;
+
+	// 1.
+	unordered_map<int, uint64_t> tablePositions;
+	vector<int> table;
+	for (size_t i = module.firstInstruction; i < endOfModule; i++)
+	{
+		int symbol = instructions[i].symbol;
+		if (symbol >= 0 && tablePositions.emplace(symbol, table.size()).second) table.push_back(symbol);
+	}
+
+	// 2.
+	string bytes(bytecodeMagic, sizeof(bytecodeMagic));
+	writeVarint(bytes, bytecodeVersion);
+	writeVarint(bytes, table.size());
+	for (int symbol : table)
+	{
+		const string& name = symbols.nameOf(symbol);
+		writeVarint(bytes, name.size());
+		bytes += name;
+	}
+	writeVarint(bytes, module.instructionCount);
+
+	// 3.
+	for (size_t i = module.firstInstruction; i < endOfModule; i++)
+	{
+		const Instruction& instruction = instructions[i];
+		CommandType commandType = commandTypeOf(instruction.opcode);
+		bool hasSegment = (commandType == C_PUSH || commandType == C_POP);
+		bool hasSymbol = (commandType == C_LABEL || commandType == C_GOTO || commandType == C_IF ||
+			commandType == C_FUNCTION || commandType == C_CALL);
+		bool hasIndex = (hasSegment || commandType == C_FUNCTION || commandType == C_CALL);
+
+		bytes += (char)instruction.opcode;
+		if (hasSegment) bytes += (char)instruction.segment;
+		if (hasSymbol) writeVarint(bytes, instruction.symbol < 0 ? 0 : tablePositions[instruction.symbol] + 1);
+		if (hasIndex) writeVarint(bytes, (uint64_t)((int64_t)instruction.index + 1));
+	}
+	return bytes;
+}
+/*
+	What it does: Converts VM files to the binary form, in parallel. Each one is written to the
+	              current folder with the .vmb extension.
+*/
+bool writeBytecodeFiles(const vector<SourceFile>& files)
+{
+	atomic<bool> allFilesWereWritten(true);
+	runInParallel(files.size(), [&](size_t i)
+	{
+		Program program;
+		parseModule(files[i].path, files[i].name, program);
+		string bytecodeFileName = withoutExtension(files[i].name) + ".vmb";
+		bool fileWasWritten = writeWholeFile(bytecodeFileName, encodeBytecode(program, program.getModules()[0]));
+		string report = (fileWasWritten ? "Wrote " : "Could not write ") + bytecodeFileName + "\n";
+		cout << report;
+		if (!fileWasWritten) allFilesWereWritten = false;
+	});
+	return allFilesWereWritten;
+}
+/*
+	What it does: Reads every file of the list whole and pushes it to the queue as soon as it has
+	              been read.
+
+	How it does it:
+
+	1. When built with VMT_USE_IO_URING and liburing is available, reads the files through an
+	   io_uring
+	2. If the ring cannot be set up, or the program is built without it, reads the files one
+	   after the other with blocking reads
+*/
+void ingestFiles(const vector<string>& filePaths, IngestedFileQueue& queue)
+{
+	// 1.
+#ifdef VMT_HAS_IO_URING
+	if (ingestFilesWithIoUring(filePaths, queue)) return;
+#endif
+
+	// 2.
+	for (size_t i = 0; i < filePaths.size(); i++)
+	{
+		IngestedFile file;
+		file.index = i;
+		readWholeFile(filePaths[i], file.contents);
+		queue.push(move(file));
+	}
+}
+bool readWholeFile(const string& fileName, string& contents)
+{
+	contents.clear();
+	ifstream file(fileName, ios::binary);
+	if (!file) return false;
+
+	// Reading in blocks, rather than through stream iterators, lets a read error (a folder
+	// named like a VM file, for instance) end the file instead of throwing.
+	char block[1 << 16];
+	while (file.read(block, sizeof(block)) || file.gcount() > 0) contents.append(block, (size_t)file.gcount());
+	return !file.bad();
+}
+#ifdef VMT_HAS_IO_URING
+/*
+	What it does: Reads the files of the list through a single io_uring.
+
+	How it does it:
+
+	1. Queues an open for every file. Operations are tagged with the index of their file times
+	   two, plus one for reads
+	2. Submits as many queued operations as the ring holds and waits for at least one of them
+	   to complete
+	3. When an open completes, sizes the buffer of the file and queues its read
+	4. When a read completes, queues a read of the rest of the file if it came back short, and
+	   pushes the file otherwise
+	5. A file the ring cannot open or read, or that is not a regular file with something in
+	   it, is read with blocking reads instead
+*/
+bool ingestFilesWithIoUring(const vector<string>& filePaths, IngestedFileQueue& queue)
+{
+	const unsigned ringDepth = 256;
+	const size_t largestRead = 1 << 30;
+	struct io_uring ring;
+	if (io_uring_queue_init(ringDepth, &ring, 0) < 0) return false;
+
+	struct PendingFile
+	{
+		int descriptor = -1;
+		size_t bytesRead = 0;
+		bool isDone = false;
+		string contents;
+	};
+	size_t fileCount = filePaths.size();
+	vector<PendingFile> pendingFiles(fileCount);
+	deque<uint64_t> queuedOperations;
+	size_t filesLeft = fileCount;
+	unsigned operationsInFlight = 0;
+
+	// 5.
+	auto pushFile = [&](size_t i, bool fileWasRead)
+	{
+		PendingFile& pendingFile = pendingFiles[i];
+		if (pendingFile.descriptor >= 0) close(pendingFile.descriptor);
+		pendingFile.descriptor = -1;
+		pendingFile.isDone = true;
+		filesLeft--;
+
+		IngestedFile file;
+		file.index = i;
+		if (fileWasRead) file.contents = move(pendingFile.contents);
+		else readWholeFile(filePaths[i], file.contents);
+		queue.push(move(file));
+	};
+
+	// 1.
+	for (size_t i = 0; i < fileCount; i++) queuedOperations.push_back(2 * i);
+
+	bool ringFailed = false;
+	while (filesLeft > 0 && !ringFailed)
+	{
+		// 2.
+		while (operationsInFlight < ringDepth && !queuedOperations.empty())
+		{
+			struct io_uring_sqe* submission = io_uring_get_sqe(&ring);
+			if (submission == nullptr) break;
+
+			uint64_t operation = queuedOperations.front();
+			queuedOperations.pop_front();
+			PendingFile& pendingFile = pendingFiles[operation / 2];
+			bool operationIsRead = (operation % 2 == 1);
+			if (operationIsRead)
+			{
+				size_t bytesLeft = min(pendingFile.contents.size() - pendingFile.bytesRead, largestRead);
+				io_uring_prep_read(submission, pendingFile.descriptor,
+					&pendingFile.contents[pendingFile.bytesRead], (unsigned)bytesLeft, pendingFile.bytesRead);
+			}
+			else io_uring_prep_openat(submission, AT_FDCWD, filePaths[operation / 2].c_str(), O_RDONLY, 0);
+			io_uring_sqe_set_data(submission, (void*)(uintptr_t)operation);
+			operationsInFlight++;
+		}
+
+		int submitted = io_uring_submit_and_wait(&ring, 1);
+		bool submissionCanBeRetried = (submitted == -EINTR || submitted == -EAGAIN || submitted == -EBUSY);
+		if (submitted < 0 && !submissionCanBeRetried) ringFailed = true;
+
+		struct io_uring_cqe* completion;
+		while (io_uring_peek_cqe(&ring, &completion) == 0)
+		{
+			uint64_t operation = (uint64_t)(uintptr_t)io_uring_cqe_get_data(completion);
+			int result = completion->res;
+			io_uring_cqe_seen(&ring, completion);
+			operationsInFlight--;
+
+			size_t i = operation / 2;
+			PendingFile& pendingFile = pendingFiles[i];
+			bool operationIsRead = (operation % 2 == 1);
+			if (!operationIsRead)
+			{
+				// 3.
+				pendingFile.descriptor = result;
+				struct stat fileStatus;
+				bool fileCanBeRead = (result >= 0 && fstat(result, &fileStatus) == 0 &&
+					S_ISREG(fileStatus.st_mode) && fileStatus.st_size > 0);
+				if (fileCanBeRead)
+				{
+					pendingFile.contents.resize((size_t)fileStatus.st_size);
+					queuedOperations.push_back(operation + 1);
+				}
+				else pushFile(i, false);
+			}
+			else
+			{
+				// 4.
+				if (result > 0) pendingFile.bytesRead += (size_t)result;
+				bool fileEnded = (result == 0 || pendingFile.bytesRead == pendingFile.contents.size());
+				if (result < 0) pushFile(i, false);
+				else if (fileEnded)
+				{
+					pendingFile.contents.resize(pendingFile.bytesRead);
+					pushFile(i, true);
+				}
+				else queuedOperations.push_back(operation);
+			}
+		}
+	}
+
+	io_uring_queue_exit(&ring);
+	for (size_t i = 0; i < fileCount; i++)
+	{
+		if (!pendingFiles[i].isDone) pushFile(i, false);
+	}
+	return true;
+}
+#endif
+#ifdef _WIN32
+/*
+	What it does:
+
+		Assumptions:
+			1. Command argument is a folder
+		Inputs:
+			1. A string containing the name of the folder
+		Output:
+			1. A string with the path to the folder to traverse
+
+	How it does it: 
+
+	1. Creates an array
+	2. Gets the current directory and puts it into the array
+	3. Iterates through the array creating a string with the path
+	4. Adds the folder to search to the path
+	5. Returns the path
+*/
+string getPath(string folderName)
+{
+	TCHAR buffer[MAX_PATH];
+	DWORD bufferLength = GetCurrentDirectory(MAX_PATH, buffer);
+	string path = "";
+	for (int index = 0; index < bufferLength; index++)
+	{
+		char currChar = buffer[index];
+		path += currChar;
+	}
+	string folderToSearch(folderName);
+	path += "\\" + folderToSearch;
+	return path;
+}
+/*
+	What it does: Finds every VM file in the received folder.
+
+	How it does it:
+
+	1. Gets the full path of the folder
+	2. Lists the folder and keeps the VM files, with their sizes
+	3. Sorts them by path, so the output does not depend on the order the file system lists
+	   them in
+	4. Leaves out the binary VM files converted from text files that are there too
+*/
+vector<SourceFile> discoverVMFiles(string folderName)
+{
+	vector<SourceFile> vmFiles;
+
+	// 1.
+	string path = getPath(folderName);
+	DIR* dirPointer = opendir(path.c_str());
+	if (dirPointer == nullptr) return vmFiles;
+
+	// 2.
+	struct dirent* entry = nullptr;
+	while ((entry = readdir(dirPointer)) != nullptr)
+	{
+		string inputFileName = entry->d_name;
+		if (!fileIsVMFile(inputFileName)) continue;
+
+		SourceFile file;
+		file.path = path + "\\" + inputFileName;
+		file.name = inputFileName;
+		struct stat fileStatus;
+		file.size = (stat(file.path.c_str(), &fileStatus) == 0) ? (size_t)fileStatus.st_size : 0;
+		vmFiles.push_back(file);
+	}
+	closedir(dirPointer);
+
+	// 3.
+	sort(vmFiles.begin(), vmFiles.end(),
+		[](const SourceFile& a, const SourceFile& b) { return a.path < b.path; });
+	// 4.
+	dropConvertedBytecode(vmFiles);
+	return vmFiles;
+}
+#else
+/*
+	What it does: Finds every VM file in the received folder and the folders inside it.
+
+	How it does it:
+
+	1. Opens the folder once. Every folder below it is opened relative to it with openat, so
+	   only the folders being listed are open at any time
+	2. Starts one thread per core. Each one takes a folder from a shared list and lists it:
+	3.   Folders are added to the shared list, for any thread to take
+	4.   VM files are kept with the size fstatat reports for them
+	5. A thread stops when the list is empty and no other thread is listing a folder, since
+	   only those could add more
+	6. Sorts the files found by path, so the output does not depend on the order the file
+	   system lists them in, or on which thread found them
+	7. Leaves out the binary VM files converted from text files that are there too
+*/
+vector<SourceFile> discoverVMFiles(string folderName)
+{
+	vector<SourceFile> vmFiles;
+
+	// 1.
+	int rootDescriptor = open(folderName.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (rootDescriptor < 0) return vmFiles;
+
+	mutex listMutex;
+	condition_variable folderAvailable;
+	deque<string> foldersToList;          // relative to the folder searched
+	size_t foldersBeingListed = 0;
+	foldersToList.push_back(".");
+
+	// 2.
+	auto lister = [&]()
+	{
+		vector<SourceFile> filesFound;
+		unique_lock<mutex> lock(listMutex);
+		while (true)
+		{
+			folderAvailable.wait(lock, [&]() { return !foldersToList.empty() || foldersBeingListed == 0; });
+			if (foldersToList.empty()) break;
+
+			string folder = move(foldersToList.front());
+			foldersToList.pop_front();
+			foldersBeingListed++;
+			lock.unlock();
+
+			int folderDescriptor = openat(rootDescriptor, folder.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+			DIR* dirPointer = (folderDescriptor >= 0) ? fdopendir(folderDescriptor) : nullptr;
+			if (dirPointer == nullptr && folderDescriptor >= 0) close(folderDescriptor);
+
+			vector<string> subfolders;
+			struct dirent* entry = nullptr;
+			while (dirPointer != nullptr && (entry = readdir(dirPointer)) != nullptr)
+			{
+				string entryName = entry->d_name;
+				bool entryIsHidden = (entryName[0] == '.');
+				bool entryIsVMFile = fileIsVMFile(entryName);
+				bool entryMayBeFolder = (entry->d_type == DT_DIR || entry->d_type == DT_UNKNOWN);
+				if (entryIsHidden || (!entryIsVMFile && !entryMayBeFolder)) continue;
+
+				struct stat entryStatus;
+				if (fstatat(folderDescriptor, entry->d_name, &entryStatus, AT_SYMLINK_NOFOLLOW) != 0) continue;
+				bool entryIsLink = S_ISLNK(entryStatus.st_mode);
+				if (entryIsLink && entryIsVMFile && fstatat(folderDescriptor, entry->d_name, &entryStatus, 0) != 0) continue;
+
+				string entryPath = (folder == ".") ? entryName : folder + "/" + entryName;
+				// 3.
+				if (S_ISDIR(entryStatus.st_mode)) subfolders.push_back(entryPath);
+				// 4.
+				else if (entryIsVMFile && S_ISREG(entryStatus.st_mode))
+				{
+					SourceFile file;
+					file.path = folderName + "/" + entryPath;
+					file.name = entryName;
+					file.size = (size_t)entryStatus.st_size;
+					filesFound.push_back(file);
+				}
+			}
+			if (dirPointer != nullptr) closedir(dirPointer);
+
+			// 5.
+			lock.lock();
+			for (string& subfolder : subfolders) foldersToList.push_back(move(subfolder));
+			foldersBeingListed--;
+			folderAvailable.notify_all();
+		}
+		for (SourceFile& file : filesFound) vmFiles.push_back(move(file));
+	};
+
+	size_t threadCount = max<size_t>(1, thread::hardware_concurrency());
+	vector<thread> pool;
+	for (size_t i = 1; i < threadCount; i++) pool.emplace_back(lister);
+	lister();    // The calling thread lists folders too
+	for (thread& poolThread : pool) poolThread.join();
+	close(rootDescriptor);
+
+	// 6.
+	sort(vmFiles.begin(), vmFiles.end(),
+		[](const SourceFile& a, const SourceFile& b) { return a.path < b.path; });
+	// 7.
+	dropConvertedBytecode(vmFiles);
+	return vmFiles;
+}
+#endif
+void dropConvertedBytecode(vector<SourceFile>& vmFiles)
+{
+	set<string> textFilePaths;
+	for (const SourceFile& file : vmFiles)
+	{
+		bool fileIsText = (file.path.size() > 3 && file.path.compare(file.path.size() - 3, 3, ".vm") == 0);
+		if (fileIsText) textFilePaths.insert(file.path);
+	}
+	auto textFormIsThere = [&](const SourceFile& file)
+	{
+		bool fileIsBytecode = (file.path.size() > 4 && file.path.compare(file.path.size() - 4, 4, ".vmb") == 0);
+		return (fileIsBytecode && textFilePaths.count(file.path.substr(0, file.path.size() - 1)) != 0);
+	};
+	vmFiles.erase(remove_if(vmFiles.begin(), vmFiles.end(), textFormIsThere), vmFiles.end());
+}
+/*
+	What it does:
+
+		Assumptions:
+					   1. There is a folder to traverse for files with VM code
+		Inputs:
+					   1. A string containing each item inside the folder being traversed
+		Output:
+					   1. True if the current file being traversed is a VM file. Otherwise, false.
+	How it does it:
+
+		1. Find the position of the last dot of the file's name
+		2. If there is a dot:
+		3.   Get the extension of the file
+		4.   If it is a vm extension return true
+		5.   else return false
+		6. else return false
+*/
+bool fileIsVMFile(string file)
+{
+	file = fileNameOf(file);
+	size_t lastDotPos = file.rfind(".");
+	bool fileHasExtension = (lastDotPos != string::npos);
+
+	if (fileHasExtension)
+	{
+		string extension = file.substr(lastDotPos + 1);
+		if (extension == "vm" || extension == "txt" || extension == "vmb") return true;
+		else return false;
+	}
+	else return false;
+}
+string fileNameOf(const string& path)
+{
+	size_t lastSeparatorPos = path.find_last_of("/\\");
+	return (lastSeparatorPos == string::npos) ? path : path.substr(lastSeparatorPos + 1);
+}
+string withoutExtension(const string& path)
+{
+	string fileName = fileNameOf(path);
+	return fileName.substr(0, fileName.rfind("."));
+}
+bool pathIsFolder(const string& path)
+{
+#ifdef _WIN32
+	struct _stat64 status;
+	return (_stat64(path.c_str(), &status) == 0 && (status.st_mode & _S_IFMT) == _S_IFDIR);
+#else
+	struct stat status;
+	return (stat(path.c_str(), &status) == 0 && S_ISDIR(status.st_mode));
+#endif
+}
+
+/*
+	What it does: Parses a whole VM file and appends its instructions to the program as a new
+	              module.
+
+	How it does it:
+
+	1. Records where the module's instructions start
+	2. Parses every line of the file into the program's instruction arena
+	3. Records the module with its file name and the number of instructions it added
+*/
+void parseModule(string filePath, string fileName, Program& program)
+{
+	size_t firstInstruction = program.getInstructions().size();
+
+	PhaseTimer timer(TranslationStats::PHASE_PARSING);
+	Parser parser(filePath, program.getSymbols());
+	parser.parseAllInto(program.getInstructions());
+	if (!parser.isValid()) cout << fileName << " is not a valid binary VM file, only the instructions before the error are translated" << endl;
+#ifdef COUNT_ALLOCATIONS
+	cout << "Allocations while parsing " << fileName << ": " << parser.getAllocatingLines() << " allocating lines of "
+		<< parser.getLinesParsed() << ", and " << parser.getAllocationsWhileInterning() << " allocations interning new names" << endl;
+#endif
+
+	addModule(fileName, firstInstruction, program);
+}
+void parseModule(IngestedFile&& file, string fileName, Program& program)
+{
+	size_t firstInstruction = program.getInstructions().size();
+
+	PhaseTimer timer(TranslationStats::PHASE_PARSING);
+	Parser parser(move(file), program.getSymbols());
+	parser.parseAllInto(program.getInstructions());
+	if (!parser.isValid()) cout << fileName << " is not a valid binary VM file, only the instructions before the error are translated" << endl;
+#ifdef COUNT_ALLOCATIONS
+	cout << "Allocations while parsing " << fileName << ": " << parser.getAllocatingLines() << " allocating lines of "
+		<< parser.getLinesParsed() << ", and " << parser.getAllocationsWhileInterning() << " allocations interning new names" << endl;
+#endif
+
+	addModule(fileName, firstInstruction, program);
+}
+/*
+	What it does: Records the instructions of the program from firstInstruction on as a new module
+	              with the received file name.
+*/
+void addModule(string fileName, size_t firstInstruction, Program& program)
+{
+	Module module;
+	module.fileName = fileName;
+	module.firstInstruction = firstInstruction;
+	module.instructionCount = program.getInstructions().size() - firstInstruction;
+	program.getModules().push_back(module);
+}
+/*
+	What it does: Translates every instruction of a module of the program through the writer.
+
+	Assumptions:
+	               1. The writer has been initialized for the module's file.
+				   2. The writer names labels and functions through the program's symbol table.
+
+	How it does it: Translates the module's instructions one after the other. If stats are kept,
+	                and the writer is the HACK one, it measures them and adds what it counted to
+					the stats at the end.
+*/
+template <typename Writer>
+void translateModule(Writer& writer, const Program& program, const Module& module)
+{
+	const vector<Instruction>& instructions = program.getInstructions();
+	size_t endOfModule = module.firstInstruction + module.instructionCount;
+
+	if constexpr (is_same<Writer, CodeWriter>::value)
+	{
+		if (translationStats != nullptr)
+		{
+			CodeGenerationCounts counts = {};
+			translateModuleMeasured(writer, program, module, counts);
+			translationStats->addCounts(counts, program.getSymbols());
+			return;
+		}
+	}
+	for (size_t i = module.firstInstruction; i < endOfModule; i++)
+	{
+		translateInstruction(writer, instructions[i]);
+	}
+}
+/*
+	What it does: Same as translateModule, but times every instruction and counts what it
+	              translates into the received counts.
+
+	How it does it: For each instruction:
+
+	1. Translates it, and charges the time since the previous one ended and the ROM words the
+	   writer wrote meanwhile to its command type
+	2. Counts its opcode, and its segment if it is a push or pop
+	3. When a function starts, charges the words written since the previous one started to the
+	   previous one. Code outside any function is charged to no function
+*/
+void translateModuleMeasured(CodeWriter& writer, const Program& program, const Module& module, CodeGenerationCounts& counts)
+{
+	const vector<Instruction>& instructions = program.getInstructions();
+	size_t endOfModule = module.firstInstruction + module.instructionCount;
+	int currentFunction = -1;
+	int functionStart = writer.getWrittenInstructions();
+	chrono::steady_clock::time_point previousEnd = chrono::steady_clock::now();
+
+	for (size_t i = module.firstInstruction; i < endOfModule; i++)
+	{
+		// 1.
+		const Instruction& instruction = instructions[i];
+		CommandType commandType = commandTypeOf(instruction.opcode);
+		int wordsBefore = writer.getWrittenInstructions();
+		bool functionStarts = (instruction.opcode == OP_FUNCTION);
+		translateInstruction(writer, instruction);
+		chrono::steady_clock::time_point end = chrono::steady_clock::now();
+		counts.commands[commandType]++;
+		counts.commandNanoseconds[commandType] += chrono::duration_cast<chrono::nanoseconds>(end - previousEnd).count();
+		counts.commandRomWords[commandType] += writer.getWrittenInstructions() - wordsBefore;
+		previousEnd = end;
+
+		// 2.
+		counts.opcodes[instruction.opcode]++;
+		if (commandType == C_PUSH || commandType == C_POP) counts.segments[instruction.segment]++;
+
+		// 3.
+		if (functionStarts)
+		{
+			if (currentFunction >= 0) counts.functionRomWords.emplace_back(currentFunction, wordsBefore - functionStart);
+			currentFunction = instruction.symbol;
+			functionStart = wordsBefore;
+		}
+	}
+	if (currentFunction >= 0) counts.functionRomWords.emplace_back(currentFunction, writer.getWrittenInstructions() - functionStart);
+}
+/*
+	What it does: Translates a single instruction through the writer.
+
+	How it does it: Switches on the command type of the instruction and calls the writer method
+	                that effects it. Labels and function names are handed over as their ids, and
+					only named by the writer when it writes them.
+*/
+template <typename Writer>
+void translateInstruction(Writer& writer, const Instruction& instruction)
+{
+	switch (commandTypeOf(instruction.opcode))
+	{
+	case C_PUSH:
+	case C_POP:
+		writer.writePushPop(instruction.opcode, instruction.segment, instruction.index);
+		break;
+	case C_ARITHMETIC:
+		writer.writeArithmetic(instruction.opcode);
+		break;
+	case C_LABEL:
+		writer.writeLabel(instruction.symbol);
+		break;
+	case C_GOTO:
+		writer.writeGOTO(instruction.symbol);
+		break;
+	case C_IF:
+		writer.writeIf(instruction.symbol);
+		break;
+	case C_CALL:
+		writer.writeCall(instruction.symbol, instruction.index);
+		break;
+	case C_FUNCTION:
+		writer.writeFunction(instruction.symbol, instruction.index);
+		break;
+	case C_RETURN:
+		writer.writeReturn();
+		break;
+	default:
+		break;
+	}
+}
+/*
+	What it does: Translates every module of the program through a single C writer, and writes
+	              the C program.
+*/
+bool writeCProgram(const Program& program)
+{
+	CSourceWriter writer(&program.getSymbols());
+	for (const Module& module : program.getModules())
+	{
+		writer.beginModule(module.fileName);
+		translateModule(writer, program, module);
+	}
+	const string& firstFileName = program.getModules()[0].fileName;
+	string outputFileName = withoutExtension(firstFileName) + ".c";
+	bool programWasWritten = writer.writeProgram(outputFileName);
+	if (programWasWritten) cout << "Wrote " << outputFileName << endl;
+	else cout << "Could not write " << outputFileName << endl;
+	return programWasWritten;
+}
+/*
+	What it does: Translates a single VM file with a parser thread and a code writer thread
+	              working at the same time.
+
+	How it does it:
+
+	1. Starts the parser thread, which:
+	2.   Decodes the file line by line straight into the next free slot of the ring
+	3.   Publishes the slot every time it is full, and marks the last one
+	4. Meanwhile, the calling thread:
+	5.   Waits for each published batch and translates its instructions
+	6.   Gives the slot back to the parser and stops after the last batch
+
+	Names are interned by the parser thread while the writer thread reads them. This is safe
+	because the symbol table never moves a stored name, and an id only reaches the writer after
+	the name it stands for has been stored.
+*/
+bool translateFilePipelined(string inputFileName)
+{
+	SymbolTable symbols;
+	unique_ptr<SPSCRing<InstructionBatch, 64>> ring(new SPSCRing<InstructionBatch, 64>());
+
+	cout << "Now Translating: " << inputFileName << endl;
+
+	// 1.
+	thread parserThread([&]()
+	{
+		Parser parser(inputFileName, symbols);
+		InstructionBatch* batch = &ring->waitForFreeSlot();
+		batch->count = 0;
+		while (parser.hasMoreLines())
+		{
+			// 2.
+			parser.advance();
+			bool thereIsCommand = (parser.getCurrentOpcode() != OP_NONE);
+			if (thereIsCommand) batch->instructions[batch->count++] = parser.getCurrentInstruction();
+
+			// 3.
+			bool batchIsFull = (batch->count == InstructionBatch::capacity);
+			if (batchIsFull)
+			{
+				batch->isLast = false;
+				ring->publish();
+				batch = &ring->waitForFreeSlot();
+				batch->count = 0;
+			}
+		}
+		if (!parser.isValid()) cout << inputFileName << " is not a valid binary VM file, only the instructions before the error are translated" << endl;
+		batch->isLast = true;
+		ring->publish();
+	});
+
+	// 4.
+	CodeWriter writer(&symbols);
+	writer.initialize(inputFileName, 0);
+	bool moreBatchesToCome = true;
+	while (moreBatchesToCome)
+	{
+		// 5.
+		const InstructionBatch& batch = ring->waitForFilledSlot();
+		for (int i = 0; i < batch.count; i++)
+		{
+			translateInstruction(writer, batch.instructions[i]);
+		}
+		// 6.
+		moreBatchesToCome = !batch.isLast;
+		ring->release();
+	}
+	parserThread.join();
+
+	bool programWasWritten = writer.finish();
+	if (programWasWritten)
+	{
+		reportWrittenProgram(writer.getOutputFileName(), writer.getBytesWritten(), writer.getFlushCount(),
+			writer.getWrittenInstructions());
+	}
+	else cout << "Could not write " << writer.getOutputFileName() << endl;
+	cout << "Parser waited " << ring->getProducerStalls() << " times for a free batch, writer waited "
+		<< ring->getConsumerStalls() << " times for a decoded batch" << endl;
+	return programWasWritten;
+}
+/*
+	What it does: Translates VM code read from the standard input, or from the received files one
+	              after the other, and writes the assembly to the standard output as it goes.
+
+	How it does it:
+
+	1. Writes the preamble to the standard output, with the first input's name for the statics
+	2. For each input:
+	3.   Reads it a block at a time, keeping the last line of the block if it is not complete yet
+	     and putting it in front of the next block. An input that is bytecode is stopped at,
+	     since bytecode can't be split into lines
+	4.   Reports a line that grows past longestLine without ending and skips it up to its end,
+	     so an input with no line breaks can't fill the memory
+	5.   Parses the complete lines of the block and translates their instructions, handing the
+	     assembly to the standard output
+	6. Reports on the standard error, since the standard output carries the assembly
+*/
+bool translateStream(const vector<string>& inputs)
+{
+	const size_t blockSize = 1 << 16;
+	const size_t longestLine = 1 << 16;
+	bool inputsWereRead = true;
+	SymbolTable symbols;
+	StandardOutputSink standardOutput;
+	CodeWriter writer(&symbols);
+	vector<Instruction> instructions;
+	size_t bytesRead = 0;
+
+	// 1.
+	auto moduleNameOf = [](const string& inputName) { return (inputName == "-" ? string("Stdin") : inputName); };
+	writer.initializeStream(moduleNameOf(inputs[0]), standardOutput);
+
+	// 2.
+	for (size_t k = 0; k < inputs.size(); k++)
+	{
+		bool inputIsStandardInput = (inputs[k] == "-");
+		FILE* input = (inputIsStandardInput ? stdin : fopen(inputs[k].c_str(), "rb"));
+		if (input == nullptr)
+		{
+			cerr << "Could not open " << inputs[k] << endl;
+			inputsWereRead = false;
+			continue;
+		}
+#ifdef _WIN32
+		if (inputIsStandardInput) _setmode(_fileno(stdin), _O_BINARY);
+#endif
+		if (k > 0) writer.initialize(moduleNameOf(inputs[k]), (int)k);
+
+		// 3.
+		string pending;
+		bool isFirstBlock = true;
+		bool isSkippingLine = false;
+		bool moreInput = true;
+		while (moreInput)
+		{
+			size_t pendingLength = pending.size();
+			pending.resize(pendingLength + blockSize);
+			size_t blockLength = readAvailableInput(input, &pending[pendingLength], blockSize);
+			pending.resize(pendingLength + blockLength);
+			bytesRead += blockLength;
+			moreInput = (blockLength > 0);
+
+			bool headerIsComplete = (pending.size() >= sizeof(bytecodeMagic) || !moreInput);
+			if (isFirstBlock && headerIsComplete && isBytecode(pending))
+			{
+				cerr << inputs[k] << " is bytecode, which can't be streamed. Only VM code as text is read" << endl;
+				inputsWereRead = false;
+				break;
+			}
+			if (headerIsComplete) isFirstBlock = false;
+
+			// 4.
+			if (isSkippingLine)
+			{
+				size_t endOfLine = pending.find('\n');
+				isSkippingLine = (endOfLine == string::npos);
+				pending.erase(0, isSkippingLine ? pending.size() : endOfLine + 1);
+			}
+			size_t endOfCompleteLines = (moreInput ? pending.rfind('\n') + 1 : pending.size());    // 0 if there is no '\n'
+			bool lineIsTooLong = (endOfCompleteLines == 0 && pending.size() > longestLine);
+			if (lineIsTooLong)
+			{
+				cerr << inputs[k] << " has a line longer than " << longestLine / 1024 << " KB, which is skipped" << endl;
+				inputsWereRead = false;
+				isSkippingLine = true;
+				string().swap(pending);
+				continue;
+			}
+			if (endOfCompleteLines == 0) continue;
+
+			// 5.
+			IngestedFile block;
+			block.index = k;
+			block.contents = pending.substr(0, endOfCompleteLines);
+			pending.erase(0, endOfCompleteLines);
+			Parser parser(move(block), symbols);
+			parser.parseAllInto(instructions);
+			for (const Instruction& instruction : instructions) translateInstruction(writer, instruction);
+			instructions.clear();
+			writer.flush();
+		}
+		if (!inputIsStandardInput) fclose(input);
+	}
+
+	// 6.
+	writer.flush();
+	cerr << "Read " << bytesRead << " bytes and wrote " << writer.getBytesWritten() << " bytes to "
+		<< writer.getOutputFileName() << " in " << writer.getFlushCount() << " flushes. The program takes "
+		<< writer.getWrittenInstructions() << " ROM words" << endl;
+	return inputsWereRead;
+}
+/*
+	What it does: Keeps translating a folder until the program is stopped.
+
+	How it does it: Forever:
+
+	1. Finds the VM files of the folder. A file whose signature is the same as the last time
+	   keeps its object module, the rest are new or changed
+	2. Translates the new and changed files in parallel, through the cache if there is one
+	3. If any file was translated, added or removed, links the program again. If every file
+	   was removed, there is nothing to link, and it says so
+	4. Waits for the next change
+*/
+void watchFolder(const string& folderName, OutputFormat outputFormat, TranslationCache* cache)
+{
+	bool toMachineCode = (outputFormat != OUTPUT_ASSEMBLY);
+	vector<SourceFile> files;
+	vector<FileSignature> signatures;
+	vector<ObjectModule> objects;
+	FolderWatcher watcher(folderName);
+
+	cout << "Watching " << folderName << (watcher.usesInotify() ? " with inotify" : " by polling")
+		<< ". Stop with Ctrl+C" << endl;
+	while (true)
+	{
+		// 1.
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		vector<SourceFile> currentFiles = discoverVMFiles(folderName);
+		unordered_map<string, size_t> previousFiles;
+		for (size_t i = 0; i < files.size(); i++) previousFiles.emplace(files[i].path, i);
+
+		size_t fileCount = currentFiles.size();
+		vector<FileSignature> currentSignatures(fileCount);
+		vector<ObjectModule> currentObjects(fileCount);
+		vector<SourceFile> changedFiles;
+		vector<size_t> changedFileIndices;
+		for (size_t i = 0; i < fileCount; i++)
+		{
+			currentSignatures[i] = signatureOf(currentFiles[i].path);
+			auto previous = previousFiles.find(currentFiles[i].path);
+			bool fileIsUnchanged = (previous != previousFiles.end() && signatures[previous->second] == currentSignatures[i]);
+			if (fileIsUnchanged) currentObjects[i] = move(objects[previous->second]);
+			else
+			{
+				changedFiles.push_back(currentFiles[i]);
+				changedFileIndices.push_back(i);
+			}
+		}
+		bool filesWereRemoved = (fileCount - changedFiles.size() < files.size());
+
+		// 2.
+		if (!changedFiles.empty())
+		{
+			vector<ObjectModule> translated = compileFilesInParallel(changedFiles, cache, toMachineCode);
+			for (size_t k = 0; k < translated.size(); k++) currentObjects[changedFileIndices[k]] = move(translated[k]);
+		}
+		files = move(currentFiles);
+		signatures = move(currentSignatures);
+		objects = move(currentObjects);
+
+		// 3.
+		bool programChanged = (!changedFiles.empty() || filesWereRemoved);
+		if (programChanged && !objects.empty())
+		{
+			linkModules(objects, false, outputFormat);
+			chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+			cout << "Translated " << changedFiles.size() << " of " << fileCount << " files and linked them in "
+				<< fixed << setprecision(1) << elapsed.count() << " ms" << endl;
+		}
+		bool everyFileWasRemoved = (programChanged && objects.empty());
+		if (everyFileWasRemoved) cout << "No VM files are left in " << folderName << ", so the program last written from them is out of date" << endl;
+
+		// 4.
+		watcher.waitForChange();
+	}
+}
+size_t peakMemoryInBytes()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS memory;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &memory, sizeof(memory))) return 0;
+	return memory.PeakWorkingSetSize;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+	return (size_t)usage.ru_maxrss;           // already in bytes
+#else
+	return (size_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+string jsonString(string_view text)
+{
+	string json = "\"";
+	for (char c : text)
+	{
+		bool characterMustBeEscaped = (c == '"' || c == '\\' || (unsigned char)c < 0x20);
+		if (!characterMustBeEscaped)
+		{
+			json += c;
+			continue;
+		}
+		char escape[8];
+		snprintf(escape, sizeof(escape), "\\u%04x", (unsigned)(unsigned char)c);
+		json += escape;
+	}
+	return json + "\"";
+}
+/*
+	What it does: Generates a VM program with about the received number of lines.
+
+	How it does it:
+
+	1. Decides how many functions there are, one every 120 lines or so, and how many arguments
+	   each takes. Sys.init calls the first one
+	2. Gives every function an equal share of the lines left and fills it with statements:
+	3.   Assignments, a push of any segment or an expression, then a pop to a writable segment
+	4.   While loops, with the condition, an if-goto out, the body and a goto back
+	5.   Ifs, with their true and false branches
+	6.   Calls to one of the next few functions, with their arguments pushed first
+	7. Ends every function with a return
+*/
+string generateVMProgram(size_t lineCount, uint64_t seed)
+{
+	SeededRandom random(seed);
+	string program;
+	program.reserve(lineCount * 18);
+	size_t linesWritten = 0;
+	auto line = [&](const string& text)
+	{
+		program += text;
+		program += '\n';
+		linesWritten++;
+	};
+
+	// 1.
+	int functionCount = (int)max<size_t>(2, lineCount / 120);
+	vector<int> argumentCounts(functionCount);
+	for (int& arguments : argumentCounts) arguments = random.below(4);
+	auto functionName = [](int function) { return "Class" + to_string(function / 8) + ".f" + to_string(function); };
+	line("function Sys.init 0");
+	for (int i = 0; i < argumentCounts[0]; i++) line("push constant " + to_string(i));
+	line("call " + functionName(0) + " " + to_string(argumentCounts[0]));
+	line("pop temp 0");
+	line("label HALT");
+	line("goto HALT");
+
+	const char* const arithmetic[] = { "add", "sub", "neg", "eq", "gt", "lt", "and", "or", "not" };
+	for (int function = 0; function < functionCount; function++)
+	{
+		// 2.
+		int localCount = random.below(6);
+		int argumentCount = argumentCounts[function];
+		size_t linesLeft = (lineCount > linesWritten ? lineCount - linesWritten : 0);
+		size_t endOfFunction = linesWritten + linesLeft / (functionCount - function);
+		int whileCount = 0, ifCount = 0;
+		auto pushAny = [&]()
+		{
+			int segment = random.below(8);
+			if (segment == 0 && argumentCount > 0) line("push argument " + to_string(random.below(argumentCount)));
+			else if (segment == 1 && localCount > 0) line("push local " + to_string(random.below(localCount)));
+			else if (segment == 2) line("push static " + to_string(random.below(16)));
+			else if (segment == 3) line("push this " + to_string(random.below(10)));
+			else if (segment == 4) line("push that " + to_string(random.below(10)));
+			else if (segment == 5) line("push pointer " + to_string(random.below(2)));
+			else if (segment == 6) line("push temp " + to_string(random.below(8)));
+			else line("push constant " + to_string(random.below(32768)));
+		};
+		auto popAny = [&]()
+		{
+			int segment = random.below(7);
+			if (segment == 0 && argumentCount > 0) line("pop argument " + to_string(random.below(argumentCount)));
+			else if (segment == 1 && localCount > 0) line("pop local " + to_string(random.below(localCount)));
+			else if (segment == 2) line("pop static " + to_string(random.below(16)));
+			else if (segment == 3) line("pop this " + to_string(random.below(10)));
+			else if (segment == 4) line("pop that " + to_string(random.below(10)));
+			else if (segment == 5) line("pop pointer " + to_string(random.below(2)));
+			else line("pop temp " + to_string(random.below(8)));
+		};
+		auto expression = [&]()
+		{
+			pushAny();
+			int operation = random.below(9);
+			bool operationIsUnary = (operation == 2 || operation == 8);
+			if (!operationIsUnary) pushAny();
+			line(arithmetic[operation]);
+		};
+
+		line("function " + functionName(function) + " " + to_string(localCount));
+		while (linesWritten < endOfFunction)
+		{
+			int statement = random.below(10);
+			if (statement < 5)
+			{
+				// 3.
+				if (random.below(2) == 0) pushAny();
+				else expression();
+				popAny();
+			}
+			else if (statement < 7)
+			{
+				// 4.
+				string number = to_string(whileCount++);
+				line("label WHILE_EXP" + number);
+				expression();
+				line("not");
+				line("if-goto WHILE_END" + number);
+				for (int k = random.below(4); k >= 0; k--)
+				{
+					expression();
+					popAny();
+				}
+				line("goto WHILE_EXP" + number);
+				line("label WHILE_END" + number);
+			}
+			else if (statement < 9)
+			{
+				// 5.
+				string number = to_string(ifCount++);
+				expression();
+				line("if-goto IF_TRUE" + number);
+				line("goto IF_FALSE" + number);
+				line("label IF_TRUE" + number);
+				expression();
+				popAny();
+				line("label IF_FALSE" + number);
+			}
+			else if (function + 1 < functionCount)
+			{
+				// 6.
+				int callee = function + 1 + random.below(min(3, functionCount - function - 1));
+				for (int i = 0; i < argumentCounts[callee]; i++) pushAny();
+				line("call " + functionName(callee) + " " + to_string(argumentCounts[callee]));
+				popAny();
+			}
+		}
+
+		// 7.
+		pushAny();
+		line("return");
+	}
+	return program;
+}
+/*
+	What it does: Measures how fast the parser alone, the code writer alone and the whole
+	              translation go through a generated program.
+
+	How it does it:
+
+	1. Generates the program, and parses it once for the code writer to translate
+	2. Runs each measurement once without measuring it, so the caches and the heap are warm,
+	   and then the received number of times, each on its own copy of the program
+	3. The parser measurement parses the program from memory. The code writer one translates
+	   the parsed program in a single in-memory writer. The whole translation parses the
+	   program, translates its functions in parallel and links them in memory
+	4. Reports the median run, which a few slow runs do not move, and the median distance of
+	   the runs from it as their spread
+*/
+void runBenchmark(size_t lineCount, uint64_t seed, int runs)
+{
+	// 1.
+	string vmCode = generateVMProgram(lineCount, seed);
+	size_t lines = (size_t)count(vmCode.begin(), vmCode.end(), '\n');
+	double megabytes = vmCode.size() / 1e6;
+	Program parsedProgram;
+	parseModule(IngestedFile{ 0, vmCode }, "Bench.vm", parsedProgram);
+	size_t bytesWritten = 0;
+
+	cout << "Benchmark program: " << lines << " lines, " << fixed << setprecision(1) << megabytes
+		<< " MB, seed " << seed << ", " << runs << " runs after one warm-up" << endl;
+
+	auto measure = [&](const char* name, auto work)
+	{
+		// 2.
+		vector<double> seconds;
+		for (int run = 0; run <= runs; run++)
+		{
+			IngestedFile file = { 0, vmCode };
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			work(move(file));
+			chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+			if (run > 0) seconds.push_back(elapsed.count());
+		}
+
+		// 4.
+		sort(seconds.begin(), seconds.end());
+		double median = seconds[seconds.size() / 2];
+		vector<double> distances;
+		for (double time : seconds) distances.push_back(abs(time - median));
+		sort(distances.begin(), distances.end());
+		double spread = distances[distances.size() / 2] / median;
+
+		cout << left << setw(14) << name << right << setprecision(2) << setw(9) << median * 1000 << " ms  "
+			<< setprecision(2) << setw(7) << lines / median / 1e6 << " M lines/s  " << setprecision(1)
+			<< setw(7) << megabytes / median << " MB/s  (min " << setprecision(2) << seconds.front() * 1000
+			<< " ms, spread " << setprecision(1) << spread * 100 << "%)" << endl;
+	};
+
+	// 3.
+	measure("Parser", [&](IngestedFile&& file)
+	{
+		Program program;
+		parseModule(move(file), "Bench.vm", program);
+		bytesWritten += program.getInstructions().size();
+	});
+	measure("CodeWriter", [&](IngestedFile&&)
+	{
+		CodeWriter writer(&parsedProgram.getSymbols());
+		writer.beginModule("Bench.vm", 0);
+		translateModule(writer, parsedProgram, parsedProgram.getModules()[0]);
+		bytesWritten += writer.takeCode().size();
+	});
+	measure("End to end", [&](IngestedFile&& file)
+	{
+		Program program;
+		parseModule(move(file), "Bench.vm", program);
+		ObjectModule object = compileModule(program, program.getModules()[0], true, false);
+		CodeWriter writer;
+		writer.beginModule("Bench.vm", 0);
+		writeRelocated(writer, object, 0);
+		bytesWritten += writer.takeCode().size();
+	});
+	cout << "Threads for the whole translation: " << max(1u, thread::hardware_concurrency())
+		<< ". Checksum: " << bytesWritten << endl;
+}
+FileSignature signatureOf(const string& fileName)
+{
+	FileSignature signature = { -1, -1 };
+#ifdef _WIN32
+	struct _stat64 status;
+	if (_stat64(fileName.c_str(), &status) != 0) return signature;
+	signature.modificationTime = (long long)status.st_mtime * 1000000000;
+#else
+	struct stat status;
+	if (stat(fileName.c_str(), &status) != 0) return signature;
+#if defined(__linux__)
+	signature.modificationTime = (long long)status.st_mtim.tv_sec * 1000000000 + status.st_mtim.tv_nsec;
+#elif defined(__APPLE__)
+	signature.modificationTime = (long long)status.st_mtimespec.tv_sec * 1000000000 + status.st_mtimespec.tv_nsec;
+#else
+	signature.modificationTime = (long long)status.st_mtime * 1000000000;
+#endif
+#endif
+	signature.size = (long long)status.st_size;
+	return signature;
+}
+size_t readAvailableInput(FILE* input, char* buffer, size_t size)
+{
+#ifdef _WIN32
+	return fread(buffer, 1, size, input);
+#else
+	ssize_t bytesRead;
+	do
+	{
+		bytesRead = read(fileno(input), buffer, size);
+	} while (bytesRead < 0 && errno == EINTR);
+	return (bytesRead > 0 ? (size_t)bytesRead : 0);
+#endif
+}
+
+// Instruction methods
+/*
+	Functionality: Returns the command type an opcode belongs to.
+*/
+CommandType commandTypeOf(Opcode opcode)
+{
+	switch (opcode)
+	{
+	case OP_ADD:
+	case OP_SUB:
+	case OP_NEG:
+	case OP_EQ:
+	case OP_GT:
+	case OP_LT:
+	case OP_AND:
+	case OP_OR:
+	case OP_NOT:      return C_ARITHMETIC;
+	case OP_PUSH:     return C_PUSH;
+	case OP_POP:      return C_POP;
+	case OP_LABEL:    return C_LABEL;
+	case OP_GOTO:     return C_GOTO;
+	case OP_IF_GOTO:  return C_IF;
+	case OP_FUNCTION: return C_FUNCTION;
+	case OP_CALL:     return C_CALL;
+	case OP_RETURN:   return C_RETURN;
+	default:          return C_NONE;
+	}
+}
+/*
+	Functionality: Returns the id of the received name, adding it to the table if it is the
+	               first time it is seen.
+
+	How it does it:
+
+	1. Looks the name up
+	2. If it is not there:
+	3.   Allocates a new chunk if the last one is full
+	4.   Stores a copy of it in the chunk, where it never moves
+	5.   Maps a view of the stored copy to the next id
+*/
+int SymbolTable::intern(string_view name)
+{
+	auto found = ids.find(name);
+	bool nameIsKnown = (found != ids.end());
+	if (nameIsKnown) return found->second;
+
+	int id = nameCount;
+	int chunk = id / namesPerChunk;
+	if (chunk >= maxChunks) throw length_error("Too many distinct labels and function names");
+	if (chunks[chunk] == nullptr) chunks[chunk].reset(new string[namesPerChunk]);
+
+	string& storedName = chunks[chunk][id % namesPerChunk];
+	storedName.assign(name.data(), name.size());
+	ids.emplace(string_view(storedName), id);
+	nameCount++;
+	return id;
+}
+
+// IngestedFileQueue class methods
+void IngestedFileQueue::push(IngestedFile&& file)
+{
+	{
+		lock_guard<mutex> lock(queueMutex);
+		files.push_back(move(file));
+	}
+	fileAvailable.notify_one();
+}
+IngestedFile IngestedFileQueue::pop()
+{
+	unique_lock<mutex> lock(queueMutex);
+	fileAvailable.wait(lock, [this]() { return !files.empty(); });
+	IngestedFile file = move(files.front());
+	files.pop_front();
+	return file;
+}
+
+// InputFile class methods
+/*
+	Functionality: Opens the received file and makes its contents available.
+
+	How it does it:
+
+	1. Tries to map the whole file read-only
+	2. If it could not be mapped, reads it into a buffer
+*/
+InputFile::InputFile(const string& fileName)
+{
+	data = nullptr;
+	length = 0;
+	isMapped = false;
+#ifdef _WIN32
+	fileHandle = INVALID_HANDLE_VALUE;
+	mappingHandle = NULL;
+#endif
+
+	if (!map(fileName)) readIntoBuffer(fileName);
+}
+InputFile::InputFile(IngestedFile&& file)
+{
+	isMapped = false;
+#ifdef _WIN32
+	fileHandle = INVALID_HANDLE_VALUE;
+	mappingHandle = NULL;
+#endif
+
+	fallbackBuffer = move(file.contents);
+	data = fallbackBuffer.data();
+	length = fallbackBuffer.size();
+}
+InputFile::~InputFile()
+{
+	if (isMapped)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(data);
+		CloseHandle(mappingHandle);
+		CloseHandle(fileHandle);
+#else
+		munmap((void*)data, length);
+#endif
+	}
+}
+/*
+	Functionality: Tries to map the received file. Returns false if it could not be mapped.
+
+	How it does it:
+
+	1. Opens the file and gets its size
+	2. If it is empty there is nothing to map
+	3. Maps the whole file read-only and tells the OS it will be read sequentially
+*/
+bool InputFile::map(const string& fileName)
+{
+#ifdef _WIN32
+	fileHandle = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (fileHandle == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER fileSize;
+	bool fileIsEmpty = (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0);
+	if (!fileIsEmpty) mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mappingHandle == NULL)
+	{
+		CloseHandle(fileHandle);
+		fileHandle = INVALID_HANDLE_VALUE;
+		return false;
+	}
+
+	const void* view = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	if (view == NULL)
+	{
+		CloseHandle(mappingHandle);
+		CloseHandle(fileHandle);
+		mappingHandle = NULL;
+		fileHandle = INVALID_HANDLE_VALUE;
+		return false;
+	}
+	data = (const char*)view;
+	length = (size_t)fileSize.QuadPart;
+#else
+	int fileDescriptor = open(fileName.c_str(), O_RDONLY);
+	if (fileDescriptor < 0) return false;
+
+	struct stat fileStatus;
+	bool fileCanBeMapped = (fstat(fileDescriptor, &fileStatus) == 0 &&
+		S_ISREG(fileStatus.st_mode) && fileStatus.st_size > 0);
+	if (!fileCanBeMapped)
+	{
+		close(fileDescriptor);
+		return false;
+	}
+
+	size_t fileSize = (size_t)fileStatus.st_size;
+	void* view = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+	close(fileDescriptor);    // The mapping stays valid after the descriptor is closed
+	if (view == MAP_FAILED) return false;
+
+	madvise(view, fileSize, MADV_SEQUENTIAL);
+	data = (const char*)view;
+	length = fileSize;
+#endif
+	isMapped = true;
+	return true;
+}
+/*
+	Functionality: Reads the received file into the fallback buffer. A file that cannot be opened
+	               is treated as empty, like an ifstream that failed to open.
+*/
+void InputFile::readIntoBuffer(const string& fileName)
+{
+	readWholeFile(fileName, fallbackBuffer);
+	data = fallbackBuffer.data();
+	length = fallbackBuffer.size();
+}
+
+// LineScanner class methods
+/*
+	Functionality: Returns the position of the lowest set bit of a non-zero mask.
+*/
+inline int lowestSetBit(uint64_t mask)
+{
+#ifdef _MSC_VER
+	unsigned long position;
+	_BitScanForward64(&position, mask);
+	return (int)position;
+#else
+	return __builtin_ctzll(mask);
+#endif
+}
+LineScanner::LineScanner(string_view textToScan)
+	: text(textToScan), nextPos(0), linesScanned(0)
+{
+}
+void LineScanner::classifyBlock(const char* block, uint64_t& newlines, uint64_t& slashes,
+	uint64_t& separators)
+{
+#if defined(__AVX2__)
+	newlines = 0;
+	slashes = 0;
+	uint64_t blanks = 0;
+	for (int half = 0; half < 2; half++)
+	{
+		__m256i bytes = _mm256_loadu_si256((const __m256i*)(block + 32 * half));
+		uint64_t isNewline = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\n')));
+		uint64_t isSlash = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('/')));
+		__m256i isBlank = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' ')),
+			_mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\t')),
+				_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\r'))));
+		newlines |= isNewline << (32 * half);
+		slashes |= isSlash << (32 * half);
+		blanks |= (uint64_t)(uint32_t)_mm256_movemask_epi8(isBlank) << (32 * half);
+	}
+	separators = blanks | newlines | slashes;
+#elif defined(__SSE2__) || defined(_M_X64)
+	newlines = 0;
+	slashes = 0;
+	uint64_t blanks = 0;
+	for (int quarter = 0; quarter < 4; quarter++)
+	{
+		__m128i bytes = _mm_loadu_si128((const __m128i*)(block + 16 * quarter));
+		uint64_t isNewline = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n')));
+		uint64_t isSlash = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('/')));
+		__m128i isBlank = _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(' ')),
+			_mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\t')),
+				_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\r'))));
+		newlines |= isNewline << (16 * quarter);
+		slashes |= isSlash << (16 * quarter);
+		blanks |= (uint64_t)(unsigned)_mm_movemask_epi8(isBlank) << (16 * quarter);
+	}
+	separators = blanks | newlines | slashes;
+#else
+	newlines = 0;
+	slashes = 0;
+	separators = 0;
+	for (int i = 0; i < 64; i++)
+	{
+		char c = block[i];
+		uint64_t bit = (uint64_t)1 << i;
+		if (c == '\n') newlines |= bit;
+		if (c == '/') slashes |= bit;
+		if (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '/') separators |= bit;
+	}
+#endif
+}
+/*
+	Functionality: Scans lines until maxLines lines with tokens have been found or the text ends.
+
+	How it does it:
+
+	1. Classifies the next 64 bytes. The last block is copied into a buffer padded with spaces
+	2. Marks the bytes where the text goes from separator to token or back
+	3. While inside a comment, skips blocks without a newline altogether
+	4. Visits every marked, newline and slash byte, lowest first:
+	5.   A newline closes the open token and the line, and ends the comment
+	6.   Inside a comment nothing else matters
+	7.   A slash closes the open token and starts a comment
+	8.   Otherwise the byte opens or closes a token
+	9. Closes the last line if the text does not end in a newline
+*/
+size_t LineScanner::scanLines(vector<ScannedLine>& lines, size_t maxLines)
+{
+	size_t linesFound = 0;
+	ScannedLine line;
+	line.tokenCount = 0;
+	bool insideToken = false;
+	bool insideComment = false;
+	size_t tokenStart = 0;
+	size_t lineStart = nextPos;
+	uint64_t previousIsSeparator = 1;
+
+	auto closeToken = [&](size_t at)
+	{
+		bool tokenIsKept = (insideToken && line.tokenCount < ScannedLine::maxTokens);
+		if (tokenIsKept)
+		{
+			line.tokenPos[line.tokenCount] = tokenStart;
+			line.tokenLength[line.tokenCount] = (unsigned)(at - tokenStart);
+			line.tokenCount++;
+		}
+		insideToken = false;
+	};
+	auto closeLine = [&]()
+	{
+		linesScanned++;
+		if (line.tokenCount > 0)
+		{
+			lines.push_back(line);
+			linesFound++;
+		}
+		line.tokenCount = 0;
+	};
+
+	for (size_t blockStart = nextPos; blockStart < text.size(); blockStart += 64)
+	{
+		// 1.
+		size_t bytesLeft = text.size() - blockStart;
+		uint64_t newlines, slashes, separators;
+		uint64_t validBytes = ~(uint64_t)0;
+		if (bytesLeft >= 64) classifyBlock(text.data() + blockStart, newlines, slashes, separators);
+		else
+		{
+			char lastBlock[64];
+			memset(lastBlock, ' ', sizeof(lastBlock));
+			memcpy(lastBlock, text.data() + blockStart, bytesLeft);
+			classifyBlock(lastBlock, newlines, slashes, separators);
+			validBytes = ((uint64_t)1 << bytesLeft) - 1;
+		}
+
+		// 2.
+		uint64_t transitions = separators ^ ((separators << 1) | previousIsSeparator);
+		previousIsSeparator = separators >> 63;
+
+		// 3.
+		if (insideComment && newlines == 0) continue;
+
+		// 4.
+		uint64_t events = (transitions | newlines | slashes) & validBytes;
+		while (events != 0)
+		{
+			int i = lowestSetBit(events);
+			events &= events - 1;
+			uint64_t bit = (uint64_t)1 << i;
+			size_t at = blockStart + i;
+
+			// 5.
+			if (newlines & bit)
+			{
+				closeToken(at);
+				closeLine();
+				insideComment = false;
+				lineStart = at + 1;
+				if (linesFound == maxLines)
+				{
+					nextPos = lineStart;
+					return linesFound;
+				}
+			}
+			// 6.
+			else if (insideComment) continue;
+			// 7.
+			else if (slashes & bit)
+			{
+				closeToken(at);
+				insideComment = true;
+			}
+			// 8.
+			else if (separators & bit) closeToken(at);
+			else
+			{
+				tokenStart = at;
+				insideToken = true;
+			}
+		}
+	}
+
+	// 9.
+	bool lastLineIsOpen = (lineStart < text.size());
+	if (lastLineIsOpen)
+	{
+		closeToken(text.size());
+		closeLine();
+	}
+	nextPos = text.size();
+	return linesFound;
+}
+
+// Parser class methods
+/*
+	Functionality: Receives the command type of the current instruction, cT, and returns true
+				   or false depending upon the syntax of the command type.
+
+*/
+bool Parser::currentCommandHasModifier()
+{
+	CommandType currentCommandType = commandTypeOf(currentInstruction.opcode);
+	bool currCommandHasModifier = (currentCommandType != C_ARITHMETIC &&
+		currentCommandType != C_RETURN);
+	if (currCommandHasModifier) return true;
+	else return false;
+}
+Parser::Parser(string fileName, SymbolTable& symbolTable)
+	: vmCode(fileName), scanner(vmCode.contents()), nextScannedLine(0), symbols(symbolTable)
+{
+	allocatingLines = 0;
+	allocationsWhileInterning = 0;
+	allocationsWhileScanning = 0;
+	scannedLines.reserve(linesPerScan);
+	currentInstruction.opcode = OP_NONE;
+	currentInstruction.segment = SEG_NONE;
+	currentInstruction.index = -1;
+	currentInstruction.symbol = -1;
+	BytecodeHeader header = readBytecodeHeader();
+	inputIsBytecode = (header != HEADER_NONE);
+	inputIsValid = (header != HEADER_INVALID);
+}
+Parser::Parser(IngestedFile&& file, SymbolTable& symbolTable)
+	: vmCode(move(file)), scanner(vmCode.contents()), nextScannedLine(0), symbols(symbolTable)
+{
+	allocatingLines = 0;
+	allocationsWhileInterning = 0;
+	allocationsWhileScanning = 0;
+	scannedLines.reserve(linesPerScan);
+	currentInstruction.opcode = OP_NONE;
+	currentInstruction.segment = SEG_NONE;
+	currentInstruction.index = -1;
+	currentInstruction.symbol = -1;
+	BytecodeHeader header = readBytecodeHeader();
+	inputIsBytecode = (header != HEADER_NONE);
+	inputIsValid = (header != HEADER_INVALID);
+}
+/*
+	Functionality: Returns true if there are more lines with an instruction. When every scanned
+	               line has been decoded, scans the next block of lines. A file in the binary form
+				   has as many instructions as its header gives; if it ends before them, it is
+				   invalid.
+*/
+bool Parser::hasMoreLines()
+{
+	if (inputIsBytecode && bytecodeInstructionsRead < bytecodeInstructionCount &&
+		nextBytecodePos == vmCode.contents().size()) inputIsValid = false;
+	if (inputIsBytecode) return (inputIsValid && bytecodeInstructionsRead < bytecodeInstructionCount);
+
+	while (nextScannedLine == scannedLines.size())
+	{
+		if (scanner.atEnd()) return false;
+		scannedLines.clear();
+		nextScannedLine = 0;
+#ifdef COUNT_ALLOCATIONS
+		size_t allocationsBeforeScan = allocationCount;
+#endif
+		scanner.scanLines(scannedLines, linesPerScan);
+#ifdef COUNT_ALLOCATIONS
+		allocationsWhileScanning += allocationCount - allocationsBeforeScan;
+#endif
+	}
+	return true;
+}
+/*
+	Functionality: Decodes the next scanned line.
+
+	How it does it:
+
+	1. Takes the tokens the scanner found in the line, every one a view of the mapped file
+	2. Looks up the first token as the command
+	3. Decodes the second token as a segment or a symbol, and the third one as the index
+
+	Decoding a line allocates nothing, except the first time a label or function name is seen.
+	With COUNT_ALLOCATIONS, a line that allocates anyway, or whose scan did, is counted, apart
+	from what interning a new name allocates.
+	Files in the binary form are decoded instead, one instruction at a time.
+*/
+void Parser::advance()
+{
+	if (inputIsBytecode)
+	{
+		advanceThroughBytecode();
+		return;
+	}
+#ifdef COUNT_ALLOCATIONS
+	size_t allocationsBeforeLine = allocationCount;
+	size_t allocationsBeforeIntern = 0;
+	size_t allocationsAfterIntern = 0;
+#endif
+	// 1.
+	const ScannedLine& currentLine = scannedLines[nextScannedLine++];
+
+	currentInstruction.opcode = OP_NONE;
+	currentInstruction.segment = SEG_NONE;
+	currentInstruction.index = -1;
+	currentInstruction.symbol = -1;
+
+	// 2.
+	currentInstruction.opcode = extractOpcodeFrom(scanner.tokenOf(currentLine, 0));
+
+	// 3.
+	bool lineIsInstruction = (currentInstruction.opcode != OP_NONE);
+	if (lineIsInstruction && currentCommandHasModifier() && currentLine.tokenCount > 1)
+	{
+		string_view modifier = scanner.tokenOf(currentLine, 1);
+		CommandType currentCommandType = commandTypeOf(currentInstruction.opcode);
+		bool modifierIsSegment = (currentCommandType == C_PUSH || currentCommandType == C_POP);
+
+		if (modifierIsSegment) currentInstruction.segment = extractSegmentFrom(modifier);
+		else
+		{
+#ifdef COUNT_ALLOCATIONS
+			allocationsBeforeIntern = allocationCount;
+#endif
+			currentInstruction.symbol = symbols.intern(modifier);
+#ifdef COUNT_ALLOCATIONS
+			allocationsAfterIntern = allocationCount;
+#endif
+		}
+	}
+
+	if (lineIsInstruction && currentInstructionHasIndex() && currentLine.tokenCount > 2)
+	{
+		currentInstruction.index = extractIndex(scanner.tokenOf(currentLine, 2));
+	}
+
+#ifdef COUNT_ALLOCATIONS
+	size_t allocationsInterning = allocationsAfterIntern - allocationsBeforeIntern;
+	size_t allocationsOfLine = allocationsWhileScanning + (allocationCount - allocationsBeforeLine) - allocationsInterning;
+	allocationsWhileInterning += allocationsInterning;
+	allocationsWhileScanning = 0;
+	if (allocationsOfLine > 0) allocatingLines++;
+#endif
+}
+/*
+	Functionality: Reads the header of a file in the binary form.
+
+	How it does it:
+
+	1. Checks the magic bytes and the version
+	2. Interns every name of the string table, remembering the id each one got
+	3. Reads the number of instructions, which can't be more than the bytes left since every
+	   instruction takes at least one, and leaves the position at the first instruction. A
+	   header that can't be read leaves nothing to decode
+*/
+Parser::BytecodeHeader Parser::readBytecodeHeader()
+{
+	nextBytecodePos = 0;
+	bytecodeInstructionCount = 0;
+	bytecodeInstructionsRead = 0;
+	string_view contents = vmCode.contents();
+
+	// 1.
+	if (!isBytecode(contents)) return HEADER_NONE;
+	size_t pos = sizeof(bytecodeMagic);
+	uint64_t version = 0, nameCount = 0, instructionCount = 0;
+	bool headerIsValid = (readVarint(contents, pos, version) && version == bytecodeVersion &&
+		readVarint(contents, pos, nameCount));
+
+	// 2.
+	for (uint64_t i = 0; headerIsValid && i < nameCount; i++)
+	{
+		uint64_t nameLength = 0;
+		headerIsValid = (readVarint(contents, pos, nameLength) && nameLength <= contents.size() - pos);
+		if (!headerIsValid) break;
+		bytecodeSymbols.push_back(symbols.intern(contents.substr(pos, (size_t)nameLength)));
+		pos += (size_t)nameLength;
+	}
+
+	// 3.
+	headerIsValid = (headerIsValid && readVarint(contents, pos, instructionCount) &&
+		instructionCount <= contents.size() - pos);
+	nextBytecodePos = headerIsValid ? pos : contents.size();
+	bytecodeInstructionCount = headerIsValid ? (size_t)instructionCount : 0;
+	return (headerIsValid ? HEADER_VALID : HEADER_INVALID);
+}
+/*
+	Functionality: Decodes the next instruction of a file in the binary form. An instruction that
+	               is cut short, has an unknown opcode or an index larger than an int holds ends
+				   the file and makes it invalid.
+*/
+void Parser::advanceThroughBytecode()
+{
+	string_view contents = vmCode.contents();
+	currentInstruction.opcode = OP_NONE;
+	currentInstruction.segment = SEG_NONE;
+	currentInstruction.index = -1;
+	currentInstruction.symbol = -1;
+
+	unsigned char opcode = (unsigned char)contents[nextBytecodePos++];
+	bool opcodeIsValid = (opcode > OP_NONE && opcode <= OP_RETURN);
+	CommandType commandType = opcodeIsValid ? commandTypeOf((Opcode)opcode) : C_NONE;
+	bool hasSegment = (commandType == C_PUSH || commandType == C_POP);
+	bool hasSymbol = (commandType == C_LABEL || commandType == C_GOTO || commandType == C_IF ||
+		commandType == C_FUNCTION || commandType == C_CALL);
+	bool hasIndex = (hasSegment || commandType == C_FUNCTION || commandType == C_CALL);
+
+	bool instructionIsComplete = opcodeIsValid;
+	uint64_t value = 0;
+	if (instructionIsComplete && hasSegment)
+	{
+		instructionIsComplete = (nextBytecodePos < contents.size() &&
+			(unsigned char)contents[nextBytecodePos] <= SEG_TEMP);
+		if (instructionIsComplete) currentInstruction.segment = (Segment)contents[nextBytecodePos++];
+	}
+	if (instructionIsComplete && hasSymbol)
+	{
+		instructionIsComplete = (readVarint(contents, nextBytecodePos, value) && value <= bytecodeSymbols.size());
+		if (instructionIsComplete && value > 0) currentInstruction.symbol = bytecodeSymbols[(size_t)value - 1];
+	}
+	if (instructionIsComplete && hasIndex)
+	{
+		instructionIsComplete = (readVarint(contents, nextBytecodePos, value) && value <= (uint64_t)INT_MAX + 1);
+		if (instructionIsComplete) currentInstruction.index = (int)(value - 1);
+	}
+
+	if (instructionIsComplete)
+	{
+		currentInstruction.opcode = (Opcode)opcode;
+		bytecodeInstructionsRead++;
+	}
+	else
+	{
+		currentInstruction.segment = SEG_NONE;
+		currentInstruction.symbol = -1;
+		currentInstruction.index = -1;
+		nextBytecodePos = contents.size();
+		inputIsValid = false;
+	}
+}
+/*
+	Functionality: Parses every remaining line of the file and appends the instructions found
+	               to the received vector. Lines without an instruction are skipped.
+*/
+void Parser::parseAllInto(vector<Instruction>& instructions)
+{
+	while (hasMoreLines())
+	{
+		advance();
+		bool thereIsCommand = (currentInstruction.opcode != OP_NONE);
+		if (thereIsCommand) instructions.push_back(currentInstruction);
+	}
+}
+/*
+	Functionality: Receives the command of the current line and returns its opcode. This
+	               function assumes that whitespaces have been removed from the current line
+				   and that it contains an instruction in JACK VM.
 
-		  1. The label to which to jump is always inside a function.
-		  2. Label has not errors.
-		  3. The compiler translates where to jump if the jump is taken.
+	Return types:
+				   OP_ADD ... OP_NOT - Arithmetic commands (C_ARITHMETIC)
+				   OP_PUSH, OP_POP, OP_LABEL, OP_GOTO, OP_IF_GOTO, OP_FUNCTION, OP_CALL, OP_RETURN
+				   OP_NONE - The command is not part of the language
 
-		Inputs:
+	The command is looked up in the compile-time keyword table.
+*/
+Opcode Parser::extractOpcodeFrom(string_view command)
+{
+	const Keyword* keyword = findKeyword(command);
+	if (keyword != nullptr) return keyword->opcode;
+	else return OP_NONE;
+}
+/*
+	Functionality: Receives the name of a virtual memory segment and returns it as a Segment.
+	               Returns SEG_NONE if the name is not a segment. The name is looked up in the
+				   compile-time keyword table.
+*/
+Segment Parser::extractSegmentFrom(string_view segment)
+{
+	const Keyword* keyword = findKeyword(segment);
+	if (keyword != nullptr) return keyword->segment;
+	else return SEG_NONE;
+}
+/*
+	Functionality: Receives the current line, cL, and determines if there is an index to be
+				   extracted from it. It supposes the current line contains a valid instruct.
+*/
+bool Parser::currentInstructionHasIndex()
+{
+	CommandType currentCommandType = commandTypeOf(currentInstruction.opcode);
+	bool currInstHasIndex = (currentCommandType == C_PUSH || currentCommandType == C_POP ||
+		currentCommandType == C_FUNCTION || currentCommandType == C_CALL);
+
+	if (currInstHasIndex) return true;
+	else return false;
+}
+/*
+	Functionality: Receives the index token of the current line and converts it in place with
+	               from_chars, so no temporary string is needed. Returns -1 if there are no
+				   digits.
+*/
+int Parser::extractIndex(string_view digits)
+{
+	int index = -1;
+	from_chars(digits.data(), digits.data() + digits.size(), index);
+	return index;
+}
+
+// FileSink class methods
+bool FileSink::open(const string& fileName)
+{
+	close();
+	file = fopen(fileName.c_str(), "wb");
+	writeFailed = (file == nullptr);
+	if (file == nullptr) return false;
+	setvbuf(file, nullptr, _IONBF, 0);
+	return true;
+}
+bool FileSink::close()
+{
+	bool fileWasWritten = !writeFailed;
+	if (file != nullptr) fileWasWritten = (fclose(file) == 0 && fileWasWritten);
+	file = nullptr;
+	writeFailed = false;
+	return fileWasWritten;
+}
+void FileSink::write(const char* data, size_t length)
+{
+	bool blockWasWritten = (file != nullptr && fwrite(data, 1, length, file) == length);
+	if (!blockWasWritten) writeFailed = true;
+}
+
+// StandardOutputSink class methods
+StandardOutputSink::StandardOutputSink()
+{
+#ifdef _WIN32
+	_setmode(_fileno(stdout), _O_BINARY);    // Keeps the lines ending in '\n' alone
+#endif
+}
+void StandardOutputSink::write(const char* data, size_t length)
+{
+	fwrite(data, 1, length, stdout);
+	fflush(stdout);
+}
+
+// AssemblyBuffer class methods
+AssemblyBuffer::AssemblyBuffer(size_t highWaterMarkInBytes)
+{
+	sink = nullptr;
+	highWaterMark = highWaterMarkInBytes;
+	bytesWritten = 0;
+	flushCount = 0;
+	buffer.reserve(highWaterMark);
+}
+void AssemblyBuffer::append(const char* text, size_t length)
+{
+	buffer.append(text, length);
+	bool bufferIsFull = (sink != nullptr && buffer.size() >= highWaterMark);
+	if (bufferIsFull) flush();
+}
+void AssemblyBuffer::flush()
+{
+	bool thereIsSomethingToWrite = (sink != nullptr && !buffer.empty());
+	if (thereIsSomethingToWrite)
+	{
+		sink->write(buffer.data(), buffer.size());
+		bytesWritten += buffer.size();
+		flushCount++;
+		buffer.clear();
+	}
+}
+/*
+	Functionality: Appends the decimal text of the received number.
+*/
+AssemblyBuffer& AssemblyBuffer::operator<<(int number)
+{
+	char digits[16];
+	to_chars_result result = to_chars(digits, digits + sizeof(digits), number);
+	append(digits, result.ptr - digits);
+	return *this;
+}
+
+// HACK snippets
+/*
+	The fixed HACK assembly text of every VM command. '%' marks where an operand goes.
+*/
+constexpr Snippet comparisonSnippet = makeSnippet(
+	"// %\n"
+	"// Stores the address of the next instruction\n"
+	"// to which to jump if (TRUE) is entered.\n"
+	"@%\n"
+	"D=A\n"
+	"@R13\n"
+	"M=D\n"
+	"// Pops both values off the stack and compares them\n"
+	"// jumps to (TRUE) if comparison is true\n"
+	"@SP\n"
+	"AM=M-1\n"
+	"D=M\n"
+	"A=A-1\n"
+	"D=M-D\n"
+	"@TRUE\n"
+	"D;J%\n"
+	"// Sets the stack to False since comparison was false.\n"
+	"@SP\n"
+	"A=M-1\n"
+	"M=0\n");
+constexpr Snippet addSnippet = makeSnippet(
+	"// ADD\n"
+	"// Accesses the two top elements of the stack\n"
+	"// Adds them, stores the result in stack.\n"
+	"@SP\n"
+	"AM=M-1\n"
+	"D=M\n"
+	"A=A-1\n"
+	"M=M+D\n");
+constexpr Snippet subSnippet = makeSnippet(
+	"// SUB\n"
+	"// Accesses the two top elements of the stack\n"
+	"// subs them, stores the result in stack.\n"
+	"@SP\n"
+	"AM=M-1\n"
+	"D=M\n"
+	"A=A-1\n"
+	"M=M-D\n");
+constexpr Snippet negSnippet = makeSnippet(
+	"// NEG\n"
+	"// Access top element stack and negates it arithmetically.\n"
+	"@SP\n"
+	"A=M-1\n"
+	"M=-M\n");
+constexpr Snippet andSnippet = makeSnippet(
+	"// AND\n"
+	"// Accesses the two top elements of the stack\n"
+	"// Ands them, stores the result in stack.\n"
+	"@SP\n"
+	"AM=M-1\n"
+	"D=M\n"
+	"A=A-1\n"
+	"M=D&M\n");
+constexpr Snippet orSnippet = makeSnippet(
+	"// OR\n"
+	"// Accesses the two top elements of the stack\n"
+	"// OR them, stores the result in stack.\n"
+	"@SP\n"
+	"AM=M-1\n"
+	"D=M\n"
+	"A=A-1\n"
+	"M=D|M\n");
+constexpr Snippet notSnippet = makeSnippet(
+	"// NOT\n"
+	"// Accesses top element in stack and NOTs it\n"
+	"@SP\n"
+	"A=M-1\n"
+	"M=!M\n");
+constexpr Snippet pushConstantSnippet = makeSnippet(
+	"// PUSH CONSTANT %\n"
+	"// Stores value to be pushed.\n"
+	"@%\n"
+	"D=A\n"
+	"// Pushes value into the stack and updates pointers\n"
+	"@SP\n"
+	"A=M\n"
+	"M=D\n"
+	"@SP\n"
+	"M=M+1\n");
+constexpr Snippet popThroughPointerSnippet = makeSnippet(
+	"// POP  % %\n"
+	"// Access last element in stack, stores it,\n"
+	"// and update pointer.\n"
+	"@SP\n"
+	"AM=M-1\n"
+	"D=M\n"
+	"@R13\n"
+	"M=D\n"
+	"// Stores value of index, adds it to the Local base\n"
+	"// and stores it in R14 temporarily.\n"
+	"@%\n"
+	"D=A\n"
+	"@%\n"
+	"D=M+D\n"
+	"@R14\n"
+	"M=D\n"
+	"// Accesses stores Stack element, Local segment\n"
+	"// register and stores element in it.\n"
+	"@R13\n"
+	"D=M\n"
+	"@R14\n"
+	"A=M\n"
+	"M=D\n");
+constexpr Snippet pushThroughPointerSnippet = makeSnippet(
+	"// PUSH % %\n"
+	"// Access address local + index and store it.\n"
+	"@%\n"
+	"D=A\n"
+	"@%\n"
+	"A=M+D\n"
+	"D=M\n"
+	"// Access next available stack reg and insert stored val.\n"
+	"@SP\n"
+	"A=M\n"
+	"M=D\n"
+	"// Update the stack pointer.\n"
+	"@SP\n"
+	"M=M+1\n");
+constexpr Snippet popFixedRegisterSnippet = makeSnippet(
+	"// POP % %\n"
+	"// Pop element from stack.\n"
+	"@SP\n"
+	"AM=M-1\n"
+	"D=M\n"
+	"// Store it in temp register.\n"
+	"@R%\n"
+	"M=D\n");
+constexpr Snippet pushFixedRegisterSnippet = makeSnippet(
+	"// POP % %\n"
+	"// Store element in register.\n"
+	"@%\n"
+	"D=M\n"
+	"// Push it into the stack and update pointer.\n"
+	"@SP\n"
+	"A=M\n"
+	"M=D\n"
+	"@SP\n"
+	"M=M+1\n");
+constexpr Snippet popStaticSnippet = makeSnippet(
+	"// POP STATIC %\n"
+	"// Access last element in stack, stores it,\n"
+	"// and update pointer.\n"
+	"@SP\n"
+	"AM=M-1\n"
+	"D=M\n"
+	"// Store element in correct static place.\n"
+	"@%.%\n"
+	"M=D\n");
+constexpr Snippet pushStaticSnippet = makeSnippet(
+	"// PUSH STATIC %\n"
+	"// Access static element to push and store it.\n"
+	"@%.%\n"
+	"D=M\n"
+	"// Store in stack and update pointer.\n"
+	"@SP\n"
+	"A=M\n"
+	"M=D\n"
+	"@SP\n"
+	"M=M+1\n");
+constexpr Snippet initSnippet = makeSnippet(
+	"// Sets up the stack\n"
+	"@256\n"
+	"D=A\n"
+	"@SP\n"
+	"M=D\n"
+	"// Calls Sys.init() \n");
+constexpr Snippet trueSnippet = makeSnippet(
+	"// Stops here if Sys.init() ever returns, so the following\n"
+	"// is never executed on first pass.\n"
+	"@%\n"
+	"0;JMP\n"
+	"// Provides all the definitions for comparison instructions.\n"
+	"(TRUE)\n"
+	"// Makes sure the value is placed in righ register\n"
+	"@SP\n"
+	"A=M-1\n"
+	"M=-1\n"
+	"// Holds the value of the instruction to which to jump\n"
+	"// After label is finished running.\n"
+	"@R13\n"
+	"A=M\n"
+	"0;JMP\n");
+constexpr Snippet labelSnippet = makeSnippet(
+	"// LABEL % IN %\n"
+	"(%$%)\n");
+constexpr Snippet gotoSnippet = makeSnippet(
+	"// GO TO (%$%)\n"
+	"@%$%\n"
+	"0;JMP\n");
+constexpr Snippet ifSnippet = makeSnippet(
+	"// IF-GOTO % IN %\n"
+	"// Pops stack and saves value.\n"
+	"@SP\n"
+	"AM=M-1\n"
+	"D=M\n"
+	"// Compares result to zero and jumps if not equal.\n"
+	"// Continues execution if comparison is equal 0.\n"
+	"@%$%\n"
+	"D;JNE\n");
+constexpr Snippet callSnippet = makeSnippet(
+	"// CALL %\n"
+	"// Pushes return address to stack\n"
+	"// Stores value to be pushed.\n"
+	"@%\n"
+	"D=A\n"
+	"// Pushes value into the stack and updates pointers\n"
+	"@SP\n"
+	"A=M\n"
+	"M=D\n"
+	"@SP\n"
+	"M=M+1\n"
+	"// Pushes the pointers LCL, THIS, THAT to stack\n"
+	"// Stores value to be pushed.\n"
+	"@R1\n"
+	"D=M\n"
+	"// Pushes value into the stack and updates pointers\n"
+	"@SP\n"
+	"A=M\n"
+	"M=D\n"
+	"@SP\n"
+	"M=M+1\n"
+	"// Stores value to be pushed.\n"
+	"@R2\n"
+	"D=M\n"
+	"// Pushes value into the stack and updates pointers\n"
+	"@SP\n"
+	"A=M\n"
+	"M=D\n"
+	"@SP\n"
+	"M=M+1\n"
+	"// Stores value to be pushed.\n"
+	"@R3\n"
+	"D=M\n"
+	"// Pushes value into the stack and updates pointers\n"
+	"@SP\n"
+	"A=M\n"
+	"M=D\n"
+	"@SP\n"
+	"M=M+1\n"
+	"// Stores value to be pushed.\n"
+	"@R4\n"
+	"D=M\n"
+	"// Pushes value into the stack and updates pointers\n"
+	"@SP\n"
+	"A=M\n"
+	"M=D\n"
+	"@SP\n"
+	"M=M+1\n"
+	"// Repositions the arg pointer to arg 0.\n"
+	"@SP\n"
+	"D=M\n"
+	"@%\n"
+	"D=D-A\n"
+	"@ARG\n"
+	"M=D\n"
+	"// Positions the LCL pointer to SP\n"
+	"@SP\n"
+	"D=M\n"
+	"@LCL\n"
+	"M=D\n"
+	"// Go to function %\n"
+	"@%\n"
+	"0;JMP\n");
+constexpr Snippet returnSnippet = makeSnippet(
+	"// RETURN\n"
+	"// Sets LCL to frame temp variable.\n"
+	"@LCL\n"
+	"D=M\n"
+	"@R5\n"
+	"M=D\n"
+	"// Saves the caller's return address to temp variable.\n"
+	"@5\n"
+	"D=A\n"
+	"@R5\n"
+	"A=M-D\n"
+	"D=M\n"
+	"@R6\n"
+	"M=D\n"
+	"// Saves the functions return value to the stack\n"
+	"@SP\n"
+	"AM=M-1\n"
+	"D=M\n"
+	"@ARG\n"
+	"A=M\n"
+	"M=D\n"
+	"// Repositions stack pointer\n"
+	"@ARG\n"
+	"D=M+1\n"
+	"@SP\n"
+	"M=D\n"
+	"// Repositions pointers in relation to frame's address\n"
+	"@R5\n"
+	"AM=M-1\n"
+	"D=M\n"
+	"@THAT\n"
+	"M=D\n"
+	"@R5\n"
+	"AM=M-1\n"
+	"D=M\n"
+	"@THIS\n"
+	"M=D\n"
+	"@R5\n"
+	"AM=M-1\n"
+	"D=M\n"
+	"@ARG\n"
+	"M=D\n"
+	"@R5\n"
+	"AM=M-1\n"
+	"D=M\n"
+	"@LCL\n"
+	"M=D\n"
+	"// Jumps to caller's return address\n"
+	"@R6\n"
+	"A=M\n"
+	"0;JMP\n");
+constexpr Snippet functionSnippet = makeSnippet(
+	"(%)\n"
+	"// Pushes 0 to % local variables\n"
+	"// Uses temp registers R5 and R6 to hold index and target\n"
+	"@R5\n"
+	"M=0\n"
+	"@%\n"
+	"D=A\n"
+	"@R6\n"
+	"M=D\n"
+	"// Enters a loop to push 0 into the stack\n");
+constexpr Snippet functionLoopSnippet = makeSnippet(
+	"// If i - % >= 0\n"
+	"@R5\n"
+	"D=M\n"
+	"@R6\n"
+	"D=D-M\n"
+	"@%\n"
+	"D;JGE\n"
+	"// Pushes 0 to stack and updates i\n"
+	"@SP\n"
+	"A=M\n"
+	"M=0\n"
+	"@SP\n"
+	"M=M+1\n"
+	"@R5\n"
+	"M=M+1\n"
+	"// Jumps back to the start of the loop\n"
+	"@%\n"
+	"0;JMP\n");
+static_assert(comparisonSnippet.assembles && addSnippet.assembles && subSnippet.assembles &&
+	negSnippet.assembles && andSnippet.assembles && orSnippet.assembles && notSnippet.assembles &&
+	pushConstantSnippet.assembles && popThroughPointerSnippet.assembles &&
+	pushThroughPointerSnippet.assembles && popFixedRegisterSnippet.assembles &&
+	pushFixedRegisterSnippet.assembles && popStaticSnippet.assembles && pushStaticSnippet.assembles &&
+	initSnippet.assembles && trueSnippet.assembles && labelSnippet.assembles && gotoSnippet.assembles && ifSnippet.assembles &&
+	callSnippet.assembles && returnSnippet.assembles && functionSnippet.assembles &&
+	functionLoopSnippet.assembles, "Every snippet must be valid HACK assembly");
+
+// CodeWriter class methods
+/*
+	Functionality: Copies a snippet to the output, putting the received operands, in order, in
+	               place of its '%' marks, and adds its ROM words to the written instruction count.
+
+	How it does it:
+
+	1. For each operand:
+	2.   Copies the text between the previous mark and the operand's mark
+	3.   Writes the operand
+	4. Copies the text after the last mark
+*/
+template <typename... Operands>
+void CodeWriter::emit(const Snippet& snippet, const Operands&... operands)
+{
+	if (writesMachineCode)
+	{
+		const SnippetOperand machineOperands[] = { SnippetOperand(operands)..., SnippetOperand(0) };
+		encode(snippet, machineOperands);
+		writtenInstructionsSoFar += snippet.romWords;
+		return;
+	}
+
+	size_t copiedSoFar = 0;
+	int operandNumber = 0;
+	auto emitOperand = [&](const auto& operand)
+	{
+		size_t operandPos = snippet.operandPos[operandNumber++];
+		output->append(snippet.text + copiedSoFar, operandPos - copiedSoFar);
+		if constexpr (is_same<decay_t<decltype(operand)>, CodeLabel>::value) writeAddressOf(operand);
+		else *output << operand;
+		copiedSoFar = operandPos + 1;
+	};
+	(emitOperand(operands), ...);
+	(void)emitOperand;    // Unused by snippets without operands
+	output->append(snippet.text + copiedSoFar, snippet.length - copiedSoFar);
+
+	writtenInstructionsSoFar += snippet.romWords;
+}
+CodeLabel CodeWriter::newLabel()
+{
+	labels.push_back({ -1, 0 });
+	return { (int)labels.size() - 1 };
+}
+/*
+	Functionality: Places the label at the next instruction to be written. Once every label
+	               referred to so far is placed, lays out the code that waited for them.
+
+	How it does it:
+
+	1. Gives the label the address of the next instruction
+	2. Its references stop waiting
+	3. If no reference is waiting any more, the code that waited can be laid out
+*/
+void CodeWriter::placeLabel(CodeLabel label)
+{
+	// 1.
+	LabelInfo& info = labels[label.id];
+	info.address = writtenInstructionsSoFar;
+
+	// 2.
+	referencesWaiting -= info.waitingReferences;
+	info.waitingReferences = 0;
+
+	// 3.
+	bool codeCanBeLaidOut = (referencesWaiting == 0 && !labelFixups.empty());
+	if (codeCanBeLaidOut) layOutUnresolvedCode();
+}
+/*
+	Functionality: Writes the address of the label, or leaves room for it in the code waiting for
+	               labels if it is not known yet.
+
+	How it does it:
+
+	1. If the label is placed and no code is waiting, writes its address right away
+	2. Otherwise, from here on code is written to the waiting code, and the place of the address
+	   in it is remembered. An address is only written once the code is laid out, even if it is
+	   known, so the offsets of the addresses come out right
+
+	Machine words have a fixed size, so machine code never waits: the address of a placed label
+	is written right away, and any other is written as 0 and remembered, to be filled in when
+	the code is laid out.
+*/
+void CodeWriter::writeAddressOf(CodeLabel label)
+{
+	LabelInfo& info = labels[label.id];
+	bool labelIsPlaced = (info.address >= 0);
+
+	if (writesMachineCode && labelIsPlaced)
+	{
+		if (recordsRomAddresses) machineCode.relocations.push_back(machineCode.words.size());
+		machineCode.words.push_back((uint16_t)info.address);
+		return;
+	}
+	if (writesMachineCode)
+	{
+		labelFixups.push_back({ machineCode.words.size(), label.id });
+		machineCode.words.push_back(0);
+		info.waitingReferences++;
+		referencesWaiting++;
+		return;
+	}
+
+	// 1.
+	if (labelIsPlaced && output == &assemblyCode)
+	{
+		if (recordsRomAddresses) romAddressOffsets.push_back(assemblyCode.contents().size());
+		assemblyCode << info.address;
+		return;
+	}
+
+	// 2.
+	output = &unresolvedCode;
+	labelFixups.push_back({ unresolvedCode.contents().size(), label.id });
+	if (!labelIsPlaced)
+	{
+		info.waitingReferences++;
+		referencesWaiting++;
+	}
+}
+/*
+	Functionality: Moves the code that waited for labels to the output, with the address of every
+	               label it refers to in place.
+
+	How it does it:
+
+	1. For each reference:
+	2.   Copies the code between the previous reference and this one
+	3.   Writes the address of the label, remembering where it goes if asked to
+	4. Copies the code after the last reference, and writes to the output again
+*/
+void CodeWriter::layOutUnresolvedCode()
+{
+	if (writesMachineCode)
+	{
+		for (const LabelFixup& fixup : labelFixups)
+		{
+			machineCode.words[fixup.offset] = (uint16_t)labels[fixup.label].address;
+			if (recordsRomAddresses) machineCode.relocations.push_back(fixup.offset);
+		}
+		labelFixups.clear();
+		return;
+	}
+
+	string_view code = unresolvedCode.contents();
+	size_t copiedSoFar = 0;
+
+	// 1.
+	for (const LabelFixup& fixup : labelFixups)
+	{
+		// 2.
+		assemblyCode.append(code.data() + copiedSoFar, fixup.offset - copiedSoFar);
+		copiedSoFar = fixup.offset;
+
+		// 3.
+		if (recordsRomAddresses) romAddressOffsets.push_back(assemblyCode.contents().size());
+		assemblyCode << labels[fixup.label].address;
+	}
+
+	// 4.
+	assemblyCode.append(code.data() + copiedSoFar, code.size() - copiedSoFar);
+	unresolvedCode.clear();
+	labelFixups.clear();
+	output = &assemblyCode;
+}
+/*
+	Functionality: Appends the machine words of a snippet to the machine code, with the received
+	               operands in place.
+
+	How it does it: For each item of the snippet:
+	                1. A known word is copied
+					2. A jump that is an operand gets its jump bits
+					3. An operand that is a label or a constant is written as such. Anything else
+					   is a symbol, named by the text of the line with the operands in place
+					4. A label declaration gets the address of the next word
+*/
+void CodeWriter::encode(const Snippet& snippet, const SnippetOperand* operands)
+{
+	vector<uint16_t>& words = machineCode.words;
+	size_t firstWord = words.size();
+	for (int k = 0; k < snippet.itemCount; k++)
+	{
+		const SnippetItem& item = snippet.items[k];
+		const SnippetOperand& operand = operands[item.firstOperand];
+		bool itemIsAnOperand = (item.textLength == 1 && snippet.text[item.textPos] == '%');
+
+		bool itemIsNamed = (item.kind == ITEM_DEFINITION ||
+			(item.kind == ITEM_REFERENCE && !(itemIsAnOperand && (operand.label >= 0 || operand.isNumber))));
+		if (itemIsNamed)
+		{
+			symbolName.clear();
+			int operandNumber = item.firstOperand;
+			for (size_t pos = item.textPos; pos < size_t(item.textPos) + item.textLength; pos++)
+			{
+				if (snippet.text[pos] == '%') symbolName += operands[operandNumber++].textOf();
+				else symbolName += snippet.text[pos];
+			}
+		}
+
+		switch (item.kind)
+		{
+		// 1.
+		case ITEM_WORD: words.push_back(item.word); break;
+		// 2.
+		case ITEM_JUMP:
+		{
+			char jump[8] = { 'J' };
+			string_view condition = operand.textOf().substr(0, sizeof(jump) - 1);
+			condition.copy(jump + 1, condition.size());
+			words.push_back(uint16_t(item.word | hackJumpBits(jump, condition.size() + 1)));
+			break;
+		}
+		// 3.
+		case ITEM_REFERENCE:
+			if (itemIsNamed) encodeReference(symbolName);
+			else if (operand.label >= 0) writeAddressOf(CodeLabel{ operand.label });
+			else if (operand.number >= 0) words.push_back((uint16_t)operand.number);
+			else encodeReference(symbolName.assign(operand.textOf()));
+			break;
+		// 4.
+		case ITEM_DEFINITION:
+			machineCode.definitions.push_back({ machineSymbolOf(symbolName), writtenInstructionsSoFar + int(words.size() - firstWord) });
+			break;
+		}
+	}
+}
+void CodeWriter::encodeReference(const string& name)
+{
+	int value = hackSymbolValue(name.data(), name.size());
+	bool nameIsKnown = (value >= 0);
+	if (!nameIsKnown) machineCode.references.push_back({ machineCode.words.size(), machineSymbolOf(name) });
+	machineCode.words.push_back(nameIsKnown ? (uint16_t)value : 0);
+}
+int CodeWriter::machineSymbolOf(const string& name)
+{
+	auto found = machineSymbolIds.find(name);
+	bool nameIsKnown = (found != machineSymbolIds.end());
+	if (nameIsKnown) return found->second;
+
+	int id = (int)machineCode.symbols.size();
+	machineCode.symbols.push_back(name);
+	machineSymbolIds.emplace(name, id);
+	return id;
+}
+const string& CodeWriter::currentFunctionName() const
+{
+	static const string outsideOfAnyFunction = "main";
+	return (currentFunction < 0 ? outsideOfAnyFunction : symbols->nameOf(currentFunction));
+}
+void CodeWriter::forgetOldLabels()
+{
+	bool noCodeWaits = labelFixups.empty();
+	if (noCodeWaits) labels.clear();
+}
+void CodeWriter::resetLabels()
+{
+	labels.clear();
+	labelFixups.clear();
+	referencesWaiting = 0;
+	unresolvedCode.clear();
+	output = &assemblyCode;
+}
+CodeWriter::~CodeWriter()
+{
+	assemblyCode.flush();
+	outputFile.close();
+}
+/*
+	Functionality: Receives a string, c, that contains an arithmetic command in JACK VM
+				   language, and outputs the translation to HACK assembly to the output file.
+
+*/
+void CodeWriter::writeArithmetic(Opcode c)
+{
+	switch (c)
+	{
+	case OP_EQ:
+	case OP_LT:
+	case OP_GT:
+	{
+		// command in upper case
+		const char* jump = "";
+		if (c == OP_EQ) jump = "EQ";
+		else if (c == OP_LT) jump = "LT";
+		else jump = "GT";
+
+		forgetOldLabels();
+		CodeLabel nextInstIfEQTrue = newLabel();
+		emit(comparisonSnippet, jump, nextInstIfEQTrue, jump);
+		placeLabel(nextInstIfEQTrue);
+		break;
+	}
+	case OP_ADD: emit(addSnippet); break;
+	case OP_SUB: emit(subSnippet); break;
+	case OP_NEG: emit(negSnippet); break;
+	case OP_AND: emit(andSnippet); break;
+	case OP_OR:  emit(orSnippet); break;
+	case OP_NOT: emit(notSnippet); break;
+	default: break;
+	}
+}
+
+/*
+	Functionality: Receives a command, c, a modifier of that command, m, and the index and
+				   pushes or pops the index to/from the stack. How the segment is reached is
+				   looked up in the compile-time segment table.
+*/
+void CodeWriter::writePushPop(Opcode c, Segment m, int i)
+{
+	const SegmentInfo& segment = segmentTable[m];
+	if (segment.access == ACCESS_CONSTANT)
+	{
+		emit(pushConstantSnippet, i, i);
+	}
+	else if (segment.access == ACCESS_THROUGH_POINTER)
+	{
+		if (c == OP_POP) emit(popThroughPointerSnippet, segment.upperCaseName, i, i, segment.baseLabel);
+		else emit(pushThroughPointerSnippet, segment.upperCaseName, i, i, segment.baseLabel);
+	}
+	else if (segment.access == ACCESS_FIXED_REGISTER)
+	{
+		int realIndex = segment.firstRegister + i;    // Segments start at R3 or R5
+
+		if (c == OP_POP) emit(popFixedRegisterSnippet, segment.upperCaseName, i, realIndex);
+		else emit(pushFixedRegisterSnippet, segment.upperCaseName, i, realIndex);
+	}
+	else
+	{
+		if (c == OP_POP) emit(popStaticSnippet, i, fileWOExtension, i);
+		else emit(pushStaticSnippet, i, fileWOExtension, i);
+	}
+}
+
+/*
+	What it does: Writes the needed preamble for every translated file. It sets up the stack
+				  pointer to 256, calls the sys.init() function of the operating system, and
+				  writes the code for the all the comparisons in the program.
+
+	How it does it: 	1. Set up the stack pointer to 256
+						2. Calls Sys.init with no arguments, like a "call Sys.init 0" command,
+						   so it has a frame of its own
+						3. Returns to a jump to itself, which stops the program if Sys.init ever
+						   returns and avoids running the (TRUE) label on the first pass
+						4. Writes the (TRUE) label, which is used by all comparison instructions
+*/
+void CodeWriter::writeInit()
+{
+	// 1.
+	forgetOldLabels();
+	CodeLabel returnAddress = newLabel();
+	emit(initSnippet);
+
+	// 2.
+	emit(callSnippet, "Sys.init", returnAddress, 5, "Sys.init", "Sys.init");
+
+	// 3.
+	placeLabel(returnAddress);
+	emit(trueSnippet, returnAddress);
+}
+
+/*
+	What it does: It handles the initializing of variables and writing of the bootstrap code
+				  The functionality depends on the number files that have been translated when
+				  it is called.
+
+	Assumptions: 1. This is only called when the driver is dealing with a folder with
+					multiple VM files.
+				 2. The file counter is never less than zero
+
+	Inputs:      1. A string containing the input file name
+				 2. An int that indicates how many files have been translated thus far.
+
+	How it does it:  1. If file is first to be translated:
+	                 2.   Set the file without extension for static variable translation
+					 3.   Set the output file name
+					 4.   Open a connection to the output file, unless writing machine code
+					 5.   Initialize the written instruction counters to 0
+					 6.   Call the writeInit() function to write the preamble of the code
+					 7. If file is not the first file to be translated:
+					 8.   Set the file without extension for static variable translation
+					 9.   Set the output file name for completeness
+*/
+void CodeWriter::initialize(string inputFileName, int filesTranslatedSoFar)
+{
+	if (filesTranslatedSoFar == 0)
+	{
+		fileWOExtension = withoutExtension(inputFileName);
+		outputFileName = fileWOExtension + ".asm";
+		if (!writesMachineCode) outputFile.open(outputFileName);
+		if (!writesMachineCode) assemblyCode.setSink(&outputFile);
+		writtenInstructionsSoFar = 0;
+		currentFunction = -1;
+		resetLabels();
+		writeInit();
+	}
+	else
+	{
+		fileWOExtension = withoutExtension(inputFileName);
+		outputFileName = fileWOExtension + ".asm";
+	}
+}
+/*
+	What it does: Same as initialize for the first file, but hands the code to the received sink
+	              instead of opening an output file.
+*/
+void CodeWriter::initializeStream(string inputFileName, OutputSink& sink)
+{
+	fileWOExtension = withoutExtension(inputFileName);
+	outputFileName = "the standard output";
+	assemblyCode.setSink(&sink);
+	writtenInstructionsSoFar = 0;
+	currentFunction = -1;
+	resetLabels();
+	writeInit();
+}
+/*
+	What it does: Prepares the writer to translate a single module into its own in-memory buffer.
+
+	How it does it:  1. Set the file without extension for static variable translation
+	                 2. Start counting written instructions from the module's first address
+					 3. Start outside of any function, like the first file does. Nothing the
+					    modules before this one did can change its code
+*/
+void CodeWriter::beginModule(string inputFileName, int firstInstructionAddress)
+{
+	fileWOExtension = withoutExtension(inputFileName);
+	outputFileName = fileWOExtension + ".asm";
+	writtenInstructionsSoFar = firstInstructionAddress;
+	currentFunction = -1;
+	resetLabels();
+}
+/*
+	What it does: Writes HACK assembly code that effects the "label" command.
+
+	Assumptions:  1. Will not be called if there is no label command.
+				  2. The label is error free
+				  3. The input refers to a label that has not been used before inside the
+				     current function.
+
+	Inputs:       1. An int, l, the id of the label in the symbol table.
+
+	How it works: 1. Get the name of the labels scope, the function being translated.
+	              2. Construct the label to be output.
+				  3. Output the label to the assembly file.
+				  4. Update the written instruction count.
+*/
+void CodeWriter::writeLabel(int l)
+{
+	const string& label = symbols->nameOf(l);
+	const string& currFunction = currentFunctionName();
+	emit(labelSnippet, label, currFunction, currFunction, label);
+}
 
-		  1. A string, l, containing the instruction to which to jump if the condition is met.
+/*
+	What it does: Writes HACK assembly code that effects the JACK VM "goto" command.
+	
+	Assumptions: 
+	1. The label is always within some function.
+	2. The passed label contains no mistakes.
+	3. The compiler takes care of returning to the correct instruction after the jump.
+					
+	Inputs: 
+	1. An int, l, the id in the symbol table of the label to which to jump.
 
-	*/
-	void writeIf(string);
-	/*
-		What it does: Writes HACK assembly code that effects the JACK VM "call" command.
+	How it works: 
+	1. Gets the name of the function to which the label belongs.
+	2. Construct the label following language specifications.
+	3. Writes the assembly instructions.
+	4. Updates the written instructions counter.
+*/
+void CodeWriter::writeGOTO(int l)
+{
+	const string& label = symbols->nameOf(l);
+	const string& currFunct = currentFunctionName();
+	emit(gotoSnippet, currFunct, label, currFunct, label);
+}
 
-		Assumptions:
+/*
+	What it does: Writes HACK assembly code that effects the JACK VM if-goto command.
 
-		Inputs:
+	Assumptions:
 
-			1. A string, fn, that contains the function name of the called function.
-			2. An int, na, that contains the number of arguments of the function.
+	  1. The label to which to jump is always inside a function.
+	  2. Label has not errors.
+	  3. The compiler translates where to jump if the jump is taken.
 
-	*/
-	void writeCall(string, int);
-	/*
-		What it does: Writes the HACK assembly instructions that effect the "return" JACK VM command.
+	Inputs:
+	
+	  1. An int, l, the id in the symbol table of the label to which to jump if the condition
+	     is met.
 
-	*/
-	void writeReturn();
+	How it works:
 
-	void writeFunction(string, int);
-};
-/*
-	What it does:
-	    Assumptions:
-		    1. Command argument is a folder
-		Inputs:
-		    1. A string containing the name of the folder
-		Output:
-		    1. A string with the path to the folder to traverse
+	  1. Get the name of the label's function
+	  2. Write the instructions to pop the stack and save the value
+	  3. Construct the label according to the language specs
+	  4. Write the assembly instructions to make the jump comparing the top of the stack to zero.
+	  5. Updates the written instruction count
 */
-string getPath(string);
+void CodeWriter::writeIf(int l)
+{
+	const string& label = symbols->nameOf(l);
+	const string& currFunct = currentFunctionName();
+	emit(ifSnippet, label, currFunct, currFunct, label);
+}
+
 /*
-	What it does:
+	What it does: Writes HACK assembly code that effects the JACK VM "call" command.
 
 	Assumptions:
-	               1. There is a folder to traverse for files with VM code
-	Inputs:
-	               1. A string containing each item inside the folder being traversed
-	Output:
-	               1. True if the current file being traversed is a VM file. Otherwise, false.
-*/
-bool fileIsVMFile(string);
 
-int main(int argc, char* argv[])
-{
+	Inputs:
 
-	// Main Logic for the end
+	    1. An int, fn, the id in the symbol table of the called function.
+		2. An int, na, that contains the number of arguments of the function.
 
-	string input = argv[1];
-	bool inputIsDir = (input.find(".") == string::npos);
-	int VMfileCounter = 0;
-
-
-	if (inputIsDir)
-	{
-		string path = getPath(input);
-		const char* pathPointer = path.c_str();
-		/*
-			Creates a structure an pointer to handle
-			traversal of file in folder
-		*/
-		struct dirent* entry = nullptr;
-		DIR* dirPointer = nullptr;
-		dirPointer = opendir(pathPointer);
-		/*
-			Iterates through each file translating it.
-		*/
-		if (dirPointer != nullptr)
-		{
-			CodeWriter writer;
-			while (entry = readdir(dirPointer))
-			{
-				string inputFileName = entry->d_name;
-				if (fileIsVMFile(inputFileName))
-				{
-					cout << "Now Translating: " << inputFileName << endl;
-					string currPath = path + "\\" + inputFileName;
-					Parser parser(currPath);
-					writer.initialize(inputFileName, VMfileCounter);
-					while (parser.hasMoreLines())
-					{
-						parser.advance();
-						string commandType = parser.getCurrentCommandType();
-
-						bool commandTypeIsReturn = (commandType == "C_RETURN");
-						bool thereIsCommand = (commandType != "");
-						if (thereIsCommand && !commandTypeIsReturn)
-						{
-							bool commandTypeIsPushPop = (commandType == "C_PUSH" ||
-								commandType == "C_POP");
-
-							if (commandTypeIsPushPop)
-							{
-								string command = parser.getCurrentCommand();
-								string modifier = parser.getCurrentModifier();
-								int index = parser.getCurrentIndex();
-
-								writer.writePushPop(command, modifier, index);
-							}
-							else if (commandType == "C_ARITHMETIC")
-							{
-								string command = parser.getCurrentCommand();
-								writer.writeArithmetic(command);
-							}
-							else if (commandType == "C_LABEL")
-							{
-								string modifier = parser.getCurrentModifier();
-								writer.writeLabel(modifier);
-							}
-							else if (commandType == "C_GOTO")
-							{
-								string label = parser.getCurrentModifier();
-								writer.writeGOTO(label);
-							}
-							else if (commandType == "C_IF")
-							{
-								string label = parser.getCurrentModifier();
-								writer.writeIf(label);
-							}
-							else if (commandType == "C_CALL")
-							{
-								string functionName = parser.getCurrentModifier();
-								int numArgs = parser.getCurrentIndex();
-
-								writer.writeCall(functionName, numArgs);
-
-							}
-							else if (commandType == "C_FUNCTION")
-							{
-								string functionName = parser.getCurrentModifier();
-								int numLocals = parser.getCurrentIndex();
-
-								writer.writeFunction(functionName, numLocals);
-							}
-						}
-						else if (thereIsCommand && commandTypeIsReturn) writer.writeReturn();
-					}
-					VMfileCounter++;
-				}
-			}
-		}
-	}
-	// Input is file
-	else
-	{
-		if (fileIsVMFile(input))
-		{
-			string inputFileName = input; 
-			Parser parser(inputFileName);
-			CodeWriter writer;
-			writer.initialize(inputFileName, VMfileCounter);
+	How it works:
 
-			while (parser.hasMoreLines())
-			{
-				parser.advance();
-				string commandType = parser.getCurrentCommandType();
+	    1. Writes assembly to push the return-address to the stack
+		2. Writes assembly to push the LCL pointer to the stack
+		3. Writes assembly to push the ARG pointer to the stack
+		4. Writes assembly to push the THIS pointer to the stack
+		5. Writes assembly to push the THAT pointer to the stack
+		6. Writes assembly to reposition the ARG pointer to SP-#Args-5
+		7. Writes assembly to repostion the LCL pointer to the SP pointer
+		8. Writes assembly to go to the function label
+		9. Writes assembly to generate a label for the return address
+*/
+void CodeWriter::writeCall(int fn, int na)
+{
+	forgetOldLabels();
+	CodeLabel retAddress = newLabel();
+	int regToArg0FromStackPointer = na + 5;
+	const string& function = symbols->nameOf(fn);
 
-				bool commandTypeIsReturn = (commandType == "C_RETURN");
-				bool thereIsCommand = (commandType != "");
-				if (thereIsCommand && !commandTypeIsReturn)
-				{
-					bool commandTypeIsPushPop = (commandType == "C_PUSH" ||
-						commandType == "C_POP");
-
-					if (commandTypeIsPushPop)
-					{
-						string command = parser.getCurrentCommand();
-						string modifier = parser.getCurrentModifier();
-						int index = parser.getCurrentIndex();
-
-						writer.writePushPop(command, modifier, index);
-					}
-					else if (commandType == "C_ARITHMETIC")
-					{
-						string command = parser.getCurrentCommand();
-						writer.writeArithmetic(command);
-					}
-					else if (commandType == "C_LABEL")
-					{
-						string modifier = parser.getCurrentModifier();
-						writer.writeLabel(modifier);
-					}
-					else if (commandType == "C_GOTO")
-					{
-						string label = parser.getCurrentModifier();
-						writer.writeGOTO(label);
-					}
-					else if (commandType == "C_IF")
-					{
-						string label = parser.getCurrentModifier();
-						writer.writeIf(label);
-					}
-					else if (commandType == "C_CALL")
-					{
-						string functionName = parser.getCurrentModifier();
-						int numArgs = parser.getCurrentIndex();
-
-						writer.writeCall(functionName, numArgs);
-
-					}
-					else if (commandType == "C_FUNCTION")
-					{
-						string functionName = parser.getCurrentModifier();
-						int numLocals = parser.getCurrentIndex();
-
-						writer.writeFunction(functionName, numLocals);
-					}
-				}
-				else if (thereIsCommand && commandTypeIsReturn) writer.writeReturn();
-			}
-		}
-	}
-	return 0;
+	emit(callSnippet, function, retAddress, regToArg0FromStackPointer, function, function);
+	placeLabel(retAddress);
 }
 
-// Main function methods
 /*
-	What it does:
-
-		Assumptions:
-			1. Command argument is a folder
-		Inputs:
-			1. A string containing the name of the folder
-		Output:
-			1. A string with the path to the folder to traverse
+	What it does: Writes the HACK assembly instructions that effect the "return" JACK VM command.
 
-	How it does it: 
+	How it works:
 
-	1. Creates an array
-	2. Gets the current directory and puts it into the array
-	3. Iterates through the array creating a string with the path
-	4. Adds the folder to search to the path
-	5. Returns the path
+		(Write HACK Assembly that)
+	    1. Save the beginning of the callee's frame.
+		2. Save the return address.
+		3. Store the return value in ARG 0.
+		4. Reposition the Stack pointer.
+		5. Reposition the THAT pointer.
+		6. Reposition the THIS pointer.
+		7. Repostion the ARG pointer.
+		8. Reposition the LCL pointer.
+		9. Go to return address in the caller's code.
 */
-string getPath(string folderName)
+void CodeWriter::writeReturn()
 {
-	TCHAR buffer[MAX_PATH];
-	DWORD bufferLength = GetCurrentDirectory(MAX_PATH, buffer);
-	string path = "";
-	for (int index = 0; index < bufferLength; index++)
-	{
-		char currChar = buffer[index];
-		path += currChar;
-	}
-	string folderToSearch(folderName);
-	path += "\\" + folderToSearch;
-	return path;
+	emit(returnSnippet);
 }
+int CodeWriter::getCallRomWords() { return callSnippet.romWords; }
+int CodeWriter::getReturnRomWords() { return returnSnippet.romWords; }
+
 /*
-	What it does:
+	What it does: Writes HACK assembly that effects the "function" JACK VM command.
 
-		Assumptions:
-					   1. There is a folder to traverse for files with VM code
-		Inputs:
-					   1. A string containing each item inside the folder being traversed
-		Output:
-					   1. True if the current file being traversed is a VM file. Otherwise, false.
-	How it does it:
+	Inputs:
 
-		1. Find the position of the dot
-		2. If there is a dot:
-		3.   Get the extension of the file
-		4.   If it is a vm extension return true
-		5.   else return false
-		6. else return false
+	    1. An int, fn, the id in the symbol table of the function
+		2. An int, nl, containing the number of local variables
+
+	How it works:
+		(Writes HACK)
+		0. Declare a label for the function entry
+	    1. Repeat nl times
+		2.    push 0
+
+	The loop refers to its start and end through labels of its own, so every function gets a
+	loop that jumps within itself.
 */
-bool fileIsVMFile(string file)
+void CodeWriter::writeFunction(int fn, int nl)
 {
-	size_t firstDotPos = file.find(".");
-	bool fileHasExtension = (firstDotPos != string::npos);
-
-	if (fileHasExtension)
-	{
-		string extension = file.substr(firstDotPos + 1);
-		if (extension == "vm" || extension == "txt") return true;
-		else return false;
-	}
-	else return false;
+	currentFunction = fn;     // Makes sure that the labels have the curr. functs. name
+	forgetOldLabels();
+	CodeLabel startOfLoop = newLabel();
+	CodeLabel endOfLoop = newLabel();
+
+	emit(functionSnippet, symbols->nameOf(fn), nl, nl);
+	placeLabel(startOfLoop);
+	emit(functionLoopSnippet, nl, endOfLoop, startOfLoop);
+	placeLabel(endOfLoop);
 }
 
-// Parser class methods
+// CSourceWriter class methods
 /*
-	Functionality: Receives the command type of the current instruction, cT, and returns true
-				   or false depending upon the syntax of the command type.
-
+	Functionality: What every C program starts with. The stack pointer is kept apart from the RAM
+	               while the program runs, so the C compiler can keep it in a register, and is
+				   stored in R0 when the program stops. Every address wraps around the 32K words of
+				   RAM, and a comparison subtracts in 16 bits and tests the difference, like the
+				   HACK code.
 */
-bool Parser::currentCommandHasModifier()
+const char* const cProgramPrelude =
+	"#include <stdint.h>\n"
+	"#include <stdio.h>\n"
+	"#include <stdlib.h>\n"
+	"\n"
+	"static uint16_t ram[32768];\n"
+	"static uint16_t sp;\n"
+	"#define RAM(address) ram[(unsigned)(address) & 0x7FFFu]\n"
+	"#define TOP RAM(sp - 1)\n"
+	"\n"
+	"static int signed16(unsigned value)\n"
+	"{\n"
+	"\tvalue &= 0xFFFFu;\n"
+	"\treturn (value & 0x8000u) ? (int)value - 65536 : (int)value;\n"
+	"}\n"
+	"static void vm_stop(const char* howItStopped, int status)\n"
+	"{\n"
+	"\tint address;\n"
+	"\tram[0] = sp;\n"
+	"\tprintf(\"The program %s. Temp:\", howItStopped);\n"
+	"\tfor (address = 5; address <= 12; address++) printf(\" %d\", signed16(ram[address]));\n"
+	"\tprintf(\"\\n\");\n"
+	"\texit(status);\n"
+	"}\n"
+	"static void vm_enter(unsigned returnAddress, unsigned argumentCount)\n"
+	"{\n"
+	"\tRAM(sp) = (uint16_t)returnAddress; sp++;\n"
+	"\tRAM(sp) = ram[1]; sp++;\n"
+	"\tRAM(sp) = ram[2]; sp++;\n"
+	"\tRAM(sp) = ram[3]; sp++;\n"
+	"\tRAM(sp) = ram[4]; sp++;\n"
+	"\tram[2] = (uint16_t)(sp - argumentCount - 5);\n"
+	"\tram[1] = sp;\n"
+	"}\n"
+	"static void vm_leave(void)\n"
+	"{\n"
+	"\tunsigned frame = ram[1];\n"
+	"\tsp--;\n"
+	"\tRAM(ram[2]) = RAM(sp);\n"
+	"\tsp = (uint16_t)(ram[2] + 1);\n"
+	"\tram[4] = RAM(frame - 1);\n"
+	"\tram[3] = RAM(frame - 2);\n"
+	"\tram[2] = RAM(frame - 3);\n"
+	"\tram[1] = RAM(frame - 4);\n"
+	"}\n"
+	"\n";
+
+string CSourceWriter::functionNameOf(int function) const
 {
-	bool currCommandHasModifier = (currentCommandType != "C_ARITHMETIC");
-	if (currCommandHasModifier) return true;
-	else return false;
+	string name = "vm_" + to_string(function) + "_";
+	for (char c : symbols->nameOf(function)) name += (isalnum((unsigned char)c) ? c : '_');
+	return name;
 }
-Parser::Parser(string fileName)
+int CSourceWriter::staticAddressOf(int index)
 {
-	vmCode.open(fileName);
-	currentInstruction = "";
-	currentCommand = "";
-	currentCommandType = "";
-	currentModifier = "";
-	currentIndex = -1;
+	int nextStatic = 16 + (int)staticAddresses.size();
+	return staticAddresses.emplace(make_pair(fileWOExtension, index), nextStatic).first->second & 0x7FFF;
 }
-bool Parser::hasMoreLines()
+void CSourceWriter::writeLine(const string& line)
 {
-	bool hasMoreLines = (vmCode.eof() == false);
-	if (hasMoreLines) return true;
-	return false;
+	if (!functionIsOpen)
+	{
+		outsideFunctionParts.push_back("vm_outside_functions_" + to_string(outsideFunctionParts.size()));
+		openFunction(outsideFunctionParts.back());
+	}
+	functionCode += "\t" + line + "\n";
+	lastLabel = -1;
+	functionEndsInJump = false;
 }
-void Parser::advance()
+void CSourceWriter::openFunction(const string& name)
 {
-	string currentLine;
-	getline(vmCode, currentLine);
-	removeWhitespaceFrom(currentLine);
-
-	if (HasInstruction(currentLine))
+	prototypes += "static void " + name + "(void);\n";
+	functionCode += "static void " + name + "(void)\n{\n";
+	functionIsOpen = true;
+	functionEndsInJump = false;
+	lastLabel = -1;
+	declaredLabels.clear();
+	usedLabels.clear();
+}
+void CSourceWriter::closeFunction()
+{
+	if (!functionIsOpen) return;
+	for (int label : usedLabels)
 	{
-		currentInstruction = currentLine;
-		currentCommand = extractCommandFrom(currentInstruction);
-		currentCommandType = extractCommandTypeFrom(currentCommand);
-
-		if (currentCommandHasModifier())
-		{
-			currentModifier = extractModifier(currentInstruction);
-		}
-		else currentModifier = "";
-
-		if (currentInstructionHasIndex())
-		{
-			currentIndex = extractIndex(currentInstruction);
-		}
-		else currentIndex = -1;
+		if (declaredLabels.count(label) != 0) continue;
+		functionCode += "L" + to_string(label) + ":\n\tvm_stop(\"went to a label nobody declares\", 1);\n";
 	}
-	else
+	if (currentFunction >= 0 && !functionEndsInJump) functionCode += "\tvm_stop(\"ran past the end of a function\", 1);\n";
+	functionCode += "}\n";
+	functionIsOpen = false;
+}
+void CSourceWriter::beginModule(string inputFileName)
+{
+	closeFunction();
+	fileWOExtension = withoutExtension(inputFileName);
+	currentFunction = -1;
+}
+/*
+	What it does: Writes the C code of an arithmetic command, which works on the top of the stack.
+*/
+void CSourceWriter::writeArithmetic(Opcode c)
+{
+	switch (c)
 	{
-		currentInstruction = "";
-		currentCommand = "";
-		currentCommandType = "";
-		currentModifier = "";
-		currentIndex = -1;
+	case OP_ADD: writeLine("sp--; TOP = (uint16_t)(TOP + RAM(sp));"); break;
+	case OP_SUB: writeLine("sp--; TOP = (uint16_t)(TOP - RAM(sp));"); break;
+	case OP_NEG: writeLine("TOP = (uint16_t)(0u - TOP);"); break;
+	case OP_EQ:  writeLine("sp--; TOP = (TOP == RAM(sp) ? 0xFFFFu : 0u);"); break;
+	case OP_GT:  writeLine("sp--; TOP = (signed16(TOP - RAM(sp)) > 0 ? 0xFFFFu : 0u);"); break;
+	case OP_LT:  writeLine("sp--; TOP = (signed16(TOP - RAM(sp)) < 0 ? 0xFFFFu : 0u);"); break;
+	case OP_AND: writeLine("sp--; TOP &= RAM(sp);"); break;
+	case OP_OR:  writeLine("sp--; TOP |= RAM(sp);"); break;
+	case OP_NOT: writeLine("TOP = (uint16_t)~TOP;"); break;
+	default: break;
 	}
 }
 /*
-	Functionality: Receives a string, cl, and removes all the spaces at the beginning in place.
-
-	General Algorithm:
-
-	1. Check if string is empty
-	2. If it is not empty:
-	3.   Look for the position of the first space character
-	4.   Look for the position of the first non-space character
-	5.   Check if there are leading spaces
-	6.   If there are:
-	7.      erase leading spaces
-	8.   Look for the position of the beginning of an in-line comment
-	9.   Check if there is an in-line comment and if it isn't a line containing just a comment
-	10.  If there is an inline comment:
-	11.    remove it from the string
-
-	Complexity: O(n) where n is the lenght of the passed string.
+	What it does: Writes the C code of a push or a pop. Each segment is reached the way
+	              writePushPop reaches it, looked up in the same segment table.
 */
-void Parser::removeWhitespaceFrom(string& cl)
+void CSourceWriter::writePushPop(Opcode c, Segment m, int i)
 {
-	bool stringIsEmpty = (cl.empty() == true);
-	if (!stringIsEmpty)
+	const SegmentInfo& segment = segmentTable[m];
+	string place;
+	if (segment.access == ACCESS_CONSTANT)
 	{
-		size_t firstSpacePos = cl.find_first_of(" ");
-		size_t firstCharPos = cl.find_first_not_of(" ");
-
-
-		bool thereAreLeadingSpaces = (firstSpacePos == 0);
-		if (thereAreLeadingSpaces)
-		{
-			cl.erase(firstSpacePos, firstCharPos);
-		}
-
-		size_t firstCommPos = cl.find_first_of("/");
-		bool thereAreInlineComments = (firstCommPos != 0 && firstCommPos != string::npos);
-		if (thereAreInlineComments)
-		{
-			cl.erase(firstCommPos);
-		}
-
-		size_t lastCharOfInstructionPos = (cl.find_last_not_of(" "));
-		bool thereAreTrailingWhiteSpaces = (cl.back() == ' ');
-		if (thereAreTrailingWhiteSpaces)
-		{
-			cl.erase(lastCharOfInstructionPos + 1);
-		}
+		writeLine("RAM(sp) = " + to_string((uint16_t)i) + "; sp++;");    // writePushPop pushes a popped constant too
+		return;
+	}
+	else if (segment.access == ACCESS_THROUGH_POINTER)
+	{
+		int pointer = hackSymbolValue(segment.baseLabel, strlen(segment.baseLabel));
+		place = "RAM(ram[" + to_string(pointer) + "] + " + to_string(i) + ")";
+	}
+	else if (segment.access == ACCESS_FIXED_REGISTER)
+	{
+		place = "ram[" + to_string((segment.firstRegister + i) & 0x7FFF) + "]";
+	}
+	else
+	{
+		place = "ram[" + to_string(staticAddressOf(i)) + "]";
 	}
+
+	if (c == OP_POP) writeLine("sp--; " + place + " = RAM(sp);");
+	else writeLine("RAM(sp) = " + place + "; sp++;");
 }
 /*
-	Functionality: Receives the current line being traversed, cL, and extracts and returns the
-				   command in a string. This functions assumes that the current line has no
-				   whitespaces and has an instruction.
+	What it does: Declares a C label, which only the function it is in can go to, like the VM
+	              label.
 */
-string Parser::extractCommandFrom(string cL)
+void CSourceWriter::writeLabel(int l)
 {
-	size_t firstSpacePos = cL.find_first_of(" ");
-	string command = cL.substr(0, firstSpacePos);
-	return command;
+	bool labelIsNew = declaredLabels.insert(l).second;
+	if (labelIsNew) writeLine("L" + to_string(l) + ": ;");
+	lastLabel = l;
 }
 /*
-	Functionality: Determines if the current line being traversed contains an instruction. If
-				   it does, returns true. This should be called after whitespaces have been
-				   removed from the current line.
-
-	Algorithm:
-
-	1. If current line is empty return false
-	2. Else if current line is a comment return false
-	3. Else return true
+	What it does: Writes a C goto, or stops the program if it goes to the label right before it,
+	              which is a loop that does nothing else.
 */
-bool Parser::HasInstruction(string cL)
+void CSourceWriter::writeGOTO(int l)
+{
+	bool jumpsToItself = (lastLabel == l);
+	usedLabels.insert(l);
+	writeLine(jumpsToItself ? "vm_stop(\"halted\", 0);" : "goto L" + to_string(l) + ";");
+	functionEndsInJump = true;
+}
+void CSourceWriter::writeIf(int l)
 {
-	bool currentLineIsEmpty = (cL.empty() == true);
-	bool currentLineIsComment = (!currentLineIsEmpty && cL.at(0) == '/');
-	if (currentLineIsEmpty) return false;
-	else if (currentLineIsComment) return false;
-	else return true;
+	usedLabels.insert(l);
+	writeLine("sp--; if (RAM(sp) != 0) goto L" + to_string(l) + ";");
 }
 /*
-	Functionality: Receives a string that contains the current line being traversed, cL, and
-				   extracts and returns the current command type from it. This function assumes
-				   that whitespaces have been removed from the current line and that it
-				   contains an instruction in JACK VM.
-
-	Return types:
-					   C_ARITHMETIC - All arithmetic commands
-					   C_PUSH
-					   C_POP
-					   C_LABEL
-					   C_GOTO
-					   C_IF
-					   C_FUNCTION
-					   C_RETURN
-					   C_CALL
-*/
-string Parser::extractCommandTypeFrom(string command)
-{
-
-
-	bool commandIsArithmetic = (command == "add" ||
-		command == "sub" ||
-		command == "gt" ||
-		command == "lt" ||
-		command == "eq" ||
-		command == "neg" ||
-		command == "and" ||
-		command == "or" ||
-		command == "not");
-
-	bool commandIsPush = (command == "push");
-	bool commandIsPop = (command == "pop");
-	bool commandIsLabel = (command == "label");
-	bool commandIsGOTO = (command == "goto");
-	bool commandIsIFGOTO = (command == "if-goto");
-	bool commandIsFunction = (command == "function");
-	bool commandIsCall = (command == "call");
-	bool commandIsReturn = (command == "return");
-
-	if (commandIsArithmetic) return "C_ARITHMETIC";
-	else if (commandIsPush) return "C_PUSH";
-	else if (commandIsPop) return "C_POP";
-	else if (commandIsLabel) return "C_LABEL";
-	else if (commandIsGOTO) return "C_GOTO";
-	else if (commandIsIFGOTO) return "C_IF";
-	else if (commandIsFunction) return "C_FUNCTION";
-	else if (commandIsCall) return "C_CALL";
-	else if (commandIsReturn) return "C_RETURN";
-
-}
-/*
-	Functionality: Access the current command and extracts the modifier from it. It assumes the
-				   program has checked if the command contains a modifier.
-*/
-string Parser::extractModifier(string cL)
-{
-	size_t firstSpacePos = cL.find_first_of(" ");
-	size_t secondSpacePos = cL.find(" ", firstSpacePos + 1);
-	string modifier = cL.substr(firstSpacePos + 1, secondSpacePos - firstSpacePos - 1);
-	return modifier;
+	What it does: Writes the C code of a call: it builds the frame like writeCall does, with the
+	              number of the call as its return address, and calls the C function of the VM
+				  function.
+*/
+void CSourceWriter::writeCall(int fn, int na)
+{
+	calledFunctions.insert(fn);
+	writeLine("vm_enter(" + to_string(callCount++ & 0xFFFF) + ", " + to_string(na) + "); " + functionNameOf(fn) + "();");
+}
+void CSourceWriter::writeReturn()
+{
+	writeLine("vm_leave(); return;");
+	functionEndsInJump = true;
 }
 /*
-	Functionality: Receives the current line, cL, and determines if there is an index to be
-				   extracted from it. It supposes the current line contains a valid instruct.
+	What it does: Ends the C function being written and starts the one of the VM function, which
+	              pushes its local variables as 0. A VM function defined again is written under a
+				  name of its own that is never called, since calls go to the first one, like in
+				  the HACK code.
 */
-bool Parser::currentInstructionHasIndex()
+void CSourceWriter::writeFunction(int fn, int nl)
 {
-	bool currInstHasIndex = (currentCommandType == "C_PUSH" || currentCommandType == "C_POP" ||
-		currentCommandType == "C_FUNCTION");
+	closeFunction();
+	currentFunction = fn;
+	bool functionIsNew = definedFunctions.insert(fn).second;
+	openFunction(functionNameOf(fn) + (functionIsNew ? "" : "_duplicate_" + to_string(duplicateFunctions++)));
+	for (int local = 0; local < nl; local++) writeLine("RAM(sp) = 0; sp++;");
+}
+/*
+	What it does: Writes the whole C program.
 
-	if (currInstHasIndex) return true;
-	else return false;
+	How it does it:
+
+	1. Ends the function being written
+	2. Writes the prelude, the declarations of the functions, the stops of the functions called
+	   but not defined, and the code of the functions
+	3. Writes main, which sets up the stack at 256 and calls Sys.init like the bootstrap does,
+	   or else runs the code outside functions, and then stops the program
+*/
+bool CSourceWriter::writeProgram(const string& fileName)
+{
+	// 1.
+	closeFunction();
+	int sysInit = -1;
+	for (int function : definedFunctions)
+	{
+		if (symbols->nameOf(function) == "Sys.init") sysInit = function;
+	}
+
+	// 2.
+	string program = cProgramPrelude + prototypes;
+	for (int function : calledFunctions)
+	{
+		if (definedFunctions.count(function) != 0) continue;
+		program += "static void " + functionNameOf(function) + "(void) { vm_stop(\"called " +
+			symbols->nameOf(function) + ", which nobody defines\", 1); }\n";
+	}
+	program += "\n" + functionCode;
+
+	// 3.
+	program += "\nint main(void)\n{\n\tsp = 256;\n";
+	if (sysInit >= 0) program += "\tvm_enter(0, 0);\n\t" + functionNameOf(sysInit) + "();\n\tvm_stop(\"halted\", 0);\n";
+	for (size_t k = 0; sysInit < 0 && k < outsideFunctionParts.size(); k++) program += "\t" + outsideFunctionParts[k] + "();\n";
+	if (sysInit < 0) program += "\tvm_stop(\"ran past the end of its code\", 0);\n";
+	program += "\treturn 0;\n}\n";
+	return writeWholeFile(fileName, program);
+}
+
+// TranslationStats class methods
+/*
+	Functionality: The names of the command types in the stats, indexed by CommandType.
+*/
+const char* const commandTypeNames[] =
+{
+	"none", "arithmetic", "push", "pop", "label", "goto", "if-goto", "function", "return", "call"
+};
+static_assert(sizeof(commandTypeNames) / sizeof(commandTypeNames[0]) == C_CALL + 1,
+	"commandTypeNames needs one entry per CommandType");
+
+TranslationStats::TranslationStats() : start(chrono::steady_clock::now()), phaseNanoseconds(),
+	counts(), outputBytes(0), programRomWords(0) {}
+void TranslationStats::addPhaseTime(Phase phase, chrono::steady_clock::duration time)
+{
+	lock_guard<mutex> lock(statsMutex);
+	phaseNanoseconds[phase] += chrono::duration_cast<chrono::nanoseconds>(time).count();
 }
-/*
-	Functionality: Receives the current line, cL, and extracts the index from it. It assumes
-				   the current line has a valid instruction and contains an index.
-*/
-int Parser::extractIndex(string cL)
+void TranslationStats::addCounts(const CodeGenerationCounts& threadCounts, const SymbolTable& symbols)
 {
-	size_t firstSpacePos = cL.find(" ");
-	size_t secondSpacePos = cL.find(" ", firstSpacePos + 1);
-	int index = stoi(cL.substr(secondSpacePos + 1));
-	return index;
+	lock_guard<mutex> lock(statsMutex);
+	for (int opcode = 0; opcode <= OP_RETURN; opcode++) counts.opcodes[opcode] += threadCounts.opcodes[opcode];
+	for (int segment = 0; segment <= SEG_TEMP; segment++) counts.segments[segment] += threadCounts.segments[segment];
+	for (int commandType = 0; commandType <= C_CALL; commandType++)
+	{
+		counts.commands[commandType] += threadCounts.commands[commandType];
+		counts.commandNanoseconds[commandType] += threadCounts.commandNanoseconds[commandType];
+		counts.commandRomWords[commandType] += threadCounts.commandRomWords[commandType];
+	}
+	for (const pair<int, int>& function : threadCounts.functionRomWords)
+	{
+		functionRomWords[string(symbols.nameOf(function.first))] += function.second;
+	}
 }
-
-// CodeWriter class methods
-CodeWriter::~CodeWriter()
+void TranslationStats::addOutput(size_t bytesWritten, int romWords)
 {
-	assemblyCode.close();
+	lock_guard<mutex> lock(statsMutex);
+	outputBytes += bytesWritten;
+	programRomWords += romWords;
 }
 /*
-	Functionality: Receives a string, c, that contains an arithmetic command in JACK VM
-				   language, and outputs the translation to HACK assembly to the output file.
+	Functionality: Writes the stats, with the peak memory of the process, to a JSON file.
+
+	How it does it:
 
+	1. Writes the wall time and the time of every phase, in milliseconds
+	2. Writes the count of every opcode and segment, named as in the VM language. The code
+	   generation phase is the time of every command type added up
+	3. Writes the count, time and ROM words of every command type, and the ROM words of every
+	   function, by name
+	4. Writes what was output and the peak memory
 */
-void CodeWriter::writeArithmetic(string c)
+bool TranslationStats::writeJson(const string& fileName) const
 {
-	bool commandIsComparison = (c == "eq" || c == "lt" || c == "gt");
-	if (commandIsComparison)
-	{
-
-		// command in upper case
-		if (c == "eq") c = "EQ";
-		else if (c == "lt") c = "LT";
-		else  c = "GT";
-
-		int instructionsInCOMPCommand = 14;
-		int addrOfNextInstIfEQTrue = writtenInstructionsSoFar + instructionsInCOMPCommand;
-
-		assemblyCode << "// " << c << endl;
-		assemblyCode << "// Stores the address of the next instruction" << endl;
-		assemblyCode << "// to which to jump if (TRUE) is entered." << endl;
-		assemblyCode << "@" << addrOfNextInstIfEQTrue << endl;
-		assemblyCode << "D=A" << endl;
-		assemblyCode << "@R13" << endl;
-		assemblyCode << "M=D" << endl;
-		assemblyCode << "// Pops both values off the stack and compares them" << endl;
-		assemblyCode << "// jumps to (TRUE) if comparison is true" << endl;
-		assemblyCode << "@SP" << endl;
-		assemblyCode << "AM=M-1" << endl;
-		assemblyCode << "D=M" << endl;
-		assemblyCode << "A=A-1" << endl;
-		assemblyCode << "D=M-D" << endl;
-		assemblyCode << "@TRUE" << endl;
-		assemblyCode << "D;J" << c << endl;
-		assemblyCode << "// Sets the stack to False since comparison was false." << endl;
-		assemblyCode << "@SP" << endl;
-		assemblyCode << "A=M-1" << endl;
-		assemblyCode << "M=0" << endl;
+	lock_guard<mutex> lock(statsMutex);
+	auto milliseconds = [](long long nanoseconds) { return to_string(nanoseconds / 1e6); };
+	const char* const phaseNames[PHASE_COUNT] = { "discovery", "parsing", "codeGeneration", "output" };
 
-		writtenInstructionsSoFar += instructionsInCOMPCommand;
+	// 1.
+	string json = "{\n\t\"wallTimeMs\": " + milliseconds(chrono::duration_cast<chrono::nanoseconds>(
+		chrono::steady_clock::now() - start).count()) + ",\n\t\"phasesMs\": {";
+	for (int phase = 0; phase < PHASE_COUNT; phase++)
+	{
+		long long nanoseconds = phaseNanoseconds[phase];
+		if (phase == PHASE_CODE_GENERATION)
+		{
+			for (long long commandNanoseconds : counts.commandNanoseconds) nanoseconds += commandNanoseconds;
+		}
+		json += string(phase == 0 ? "" : ",") + "\n\t\t\"" + phaseNames[phase] + "\": " + milliseconds(nanoseconds);
 	}
 
-	else if (c == "add")
+	// 2.
+	string opcodes, segments;
+	for (const Keyword& keyword : keywords)
 	{
-		assemblyCode << "// ADD" << endl;
-		assemblyCode << "// Accesses the two top elements of the stack" << endl;
-		assemblyCode << "// Adds them, stores the result in stack." << endl;
-		assemblyCode << "@SP" << endl;
-		assemblyCode << "AM=M-1" << endl;
-		assemblyCode << "D=M" << endl;
-		assemblyCode << "A=A-1" << endl;
-		assemblyCode << "M=M+D" << endl;
-
-		writtenInstructionsSoFar += 5;
+		bool keywordIsCommand = (keyword.opcode != OP_NONE);
+		string& list = (keywordIsCommand ? opcodes : segments);
+		size_t count = (keywordIsCommand ? counts.opcodes[keyword.opcode] : counts.segments[keyword.segment]);
+		list += string(list.empty() ? "" : ",") + "\n\t\t" + jsonString(keyword.text) + ": " + to_string(count);
 	}
-	else if (c == "sub")
-	{
-		assemblyCode << "// SUB" << endl;
-		assemblyCode << "// Accesses the two top elements of the stack" << endl;
-		assemblyCode << "// subs them, stores the result in stack." << endl;
-		assemblyCode << "@SP" << endl;
-		assemblyCode << "AM=M-1" << endl;
-		assemblyCode << "D=M" << endl;
-		assemblyCode << "A=A-1" << endl;
-		assemblyCode << "M=M-D" << endl;
+	json += "\n\t},\n\t\"opcodes\": {" + opcodes + "\n\t},\n\t\"segments\": {" + segments + "\n\t},";
 
-		writtenInstructionsSoFar += 5;
-	}
-	else if (c == "neg")
+	// 3.
+	json += "\n\t\"commandTypes\": {";
+	for (int commandType = C_ARITHMETIC; commandType <= C_CALL; commandType++)
 	{
-		assemblyCode << "// NEG" << endl;
-		assemblyCode << "// Access top element stack and negates it arithmetically." << endl;
-		assemblyCode << "@SP" << endl;
-		assemblyCode << "A=M-1" << endl;
-		assemblyCode << "M=-M" << endl;
-
-		writtenInstructionsSoFar += 3;
+		json += string(commandType == C_ARITHMETIC ? "" : ",") + "\n\t\t\"" + commandTypeNames[commandType] +
+			"\": { \"count\": " + to_string(counts.commands[commandType]) +
+			", \"romWords\": " + to_string(counts.commandRomWords[commandType]) +
+			", \"codeGenerationMs\": " + milliseconds(counts.commandNanoseconds[commandType]) + " }";
 	}
-	else if (c == "and")
+	json += "\n\t},\n\t\"functionRomWords\": {";
+	for (auto function = functionRomWords.begin(); function != functionRomWords.end(); function++)
 	{
-		assemblyCode << "// AND" << endl;
-		assemblyCode << "// Accesses the two top elements of the stack" << endl;
-		assemblyCode << "// Ands them, stores the result in stack." << endl;
-		assemblyCode << "@SP" << endl;
-		assemblyCode << "AM=M-1" << endl;
-		assemblyCode << "D=M" << endl;
-		assemblyCode << "A=A-1" << endl;
-		assemblyCode << "M=D&M" << endl;
-
-		writtenInstructionsSoFar += 5;
+		json += string(function == functionRomWords.begin() ? "" : ",") + "\n\t\t" + jsonString(function->first) +
+			": " + to_string(function->second);
 	}
-	else if (c == "or")
-	{
-		assemblyCode << "// OR" << endl;
-		assemblyCode << "// Accesses the two top elements of the stack" << endl;
-		assemblyCode << "// OR them, stores the result in stack." << endl;
-		assemblyCode << "@SP" << endl;
-		assemblyCode << "AM=M-1" << endl;
-		assemblyCode << "D=M" << endl;
-		assemblyCode << "A=A-1" << endl;
-		assemblyCode << "M=D|M" << endl;
 
+	// 4.
+	json += "\n\t},\n\t\"outputBytes\": " + to_string(outputBytes) + ",\n\t\"programRomWords\": " +
+		to_string(programRomWords) + ",\n\t\"peakMemoryBytes\": " + to_string(peakMemoryInBytes()) + "\n}\n";
+	return writeWholeFile(fileName, json);
+}
 
-		writtenInstructionsSoFar += 5;
-	}
-	else if (c == "not")
+// HackEmulator class methods
+/*
+	Functionality: Decodes every word of the program: an A-instruction keeps the value it loads,
+	               a C-instruction its computation, destination and jump bits.
+*/
+HackEmulator::HackEmulator(const vector<uint16_t>& words) : rom(words.size()), ram(65536, 0),
+	addressCycles(words.size(), 0), cycles(0), largestStackPointer(0), stopReason(STOP_HALTED)
+{
+	for (size_t address = 0; address < words.size(); address++)
 	{
-		assemblyCode << "// NOT" << endl;
-		assemblyCode << "// Accesses top element in stack and NOTs it" << endl;
-		assemblyCode << "@SP" << endl;
-		assemblyCode << "A=M-1" << endl;
-		assemblyCode << "M=!M" << endl;
-
-		writtenInstructionsSoFar += 3;
+		uint16_t word = words[address];
+		DecodedWord& decoded = rom[address];
+		decoded.isAInstruction = ((word & 0x8000) == 0);
+		decoded.computation = (uint8_t)((word >> 6) & 0x7F);
+		decoded.destination = (uint8_t)((word >> 3) & 7);
+		decoded.jump = (uint8_t)(word & 7);
+		decoded.value = word;
 	}
 }
 /*
-	Functionality: Receives a command, c, a modifier of that command, m, and the index and
-				   pushes or pops the index to/from the stack.
-*/
-void CodeWriter::writePushPop(string c, string m, int i)
-{
-	if (m == "constant")
-	{
-		assemblyCode << "// PUSH CONSTANT " << i << endl;
-		assemblyCode << "// Stores value to be pushed." << endl;
-		assemblyCode << "@" << i << endl;
-		assemblyCode << "D=A" << endl;
-		assemblyCode << "// Pushes value into the stack and updates pointers" << endl;
-		assemblyCode << "@SP" << endl;
-		assemblyCode << "A=M" << endl;
-		assemblyCode << "M=D" << endl;
-		assemblyCode << "@SP" << endl;
-		assemblyCode << "M=M+1" << endl;
-
-		writtenInstructionsSoFar += 7;
-	}
-	else if (m == "local" || m == "argument" || m == "this" || m == "that")
-	{
-		string predefLabel = "";
-		if (m == "local") { predefLabel = "LCL"; m = "LOCAL"; }
-		else if (m == "argument") { predefLabel = "ARG", m = "ARGUMENT"; }
-		else if (m == "this") { predefLabel = "THIS"; m = "THIS"; }
-		else if (m == "that") { predefLabel = "THAT"; m = "THAT"; }
-
-		if (c == "pop")
-		{
-
-			assemblyCode << "// POP  " << m << " " << i << endl;
-			assemblyCode << "// Access last element in stack, stores it," << endl;
-			assemblyCode << "// and update pointer." << endl;
-			assemblyCode << "@SP" << endl;
-			assemblyCode << "AM=M-1" << endl;
-			assemblyCode << "D=M" << endl;
-			assemblyCode << "@R13" << endl;
-			assemblyCode << "M=D" << endl;
-			assemblyCode << "// Stores value of index, adds it to the Local base" << endl;
-			assemblyCode << "// and stores it in R14 temporarily." << endl;
-			assemblyCode << "@" << i << endl;
-			assemblyCode << "D=A" << endl;
-			assemblyCode << "@" << predefLabel << endl;
-			assemblyCode << "D=M+D" << endl;
-			assemblyCode << "@R14" << endl;
-			assemblyCode << "M=D" << endl;
-			assemblyCode << "// Accesses stores Stack element, Local segment" << endl;
-			assemblyCode << "// register and stores element in it." << endl;
-			assemblyCode << "@R13" << endl;
-			assemblyCode << "D=M" << endl;
-			assemblyCode << "@R14" << endl;
-			assemblyCode << "A=M" << endl;
-			assemblyCode << "M=D" << endl;
-
-			writtenInstructionsSoFar += 16;
-		}
-		else
-		{
-			assemblyCode << "// PUSH " << m << " " << i << endl;
-			assemblyCode << "// Access address local + index and store it." << endl;
-			assemblyCode << "@" << i << endl;
-			assemblyCode << "D=A" << endl;
-			assemblyCode << "@" << predefLabel << endl;
-			assemblyCode << "A=M+D" << endl;
-			assemblyCode << "D=M" << endl;
-			assemblyCode << "// Access next available stack reg and insert stored val." << endl;
-			assemblyCode << "@SP" << endl;
-			assemblyCode << "A=M" << endl;
-			assemblyCode << "M=D" << endl;
-			assemblyCode << "// Update the stack pointer." << endl;
-			assemblyCode << "@SP" << endl;
-			assemblyCode << "M=M+1" << endl;
+	Functionality: Returns what the ALU outputs for the received computation bits.
 
-			writtenInstructionsSoFar += 10;
-		}
+	How it does it: Computes the computations the HACK assembly language names directly, and any
+	                other combination of the six ALU bits (zx, nx, zy, ny, f, no) bit by bit.
+*/
+uint16_t HackEmulator::compute(uint8_t computation, uint16_t x, uint16_t y)
+{
+	switch (computation & 0x3F)
+	{
+	case 0x2A: return 0;
+	case 0x3F: return 1;
+	case 0x3A: return 0xFFFF;
+	case 0x0C: return x;
+	case 0x30: return y;
+	case 0x0D: return (uint16_t)~x;
+	case 0x31: return (uint16_t)~y;
+	case 0x0F: return (uint16_t)-x;
+	case 0x33: return (uint16_t)-y;
+	case 0x1F: return (uint16_t)(x + 1);
+	case 0x37: return (uint16_t)(y + 1);
+	case 0x0E: return (uint16_t)(x - 1);
+	case 0x32: return (uint16_t)(y - 1);
+	case 0x02: return (uint16_t)(x + y);
+	case 0x13: return (uint16_t)(x - y);
+	case 0x07: return (uint16_t)(y - x);
+	case 0x00: return x & y;
+	case 0x15: return x | y;
+	default: break;
 	}
-	else if (m == "temp" || m == "pointer")
+	if (computation & 0x20) x = 0;
+	if (computation & 0x10) x = (uint16_t)~x;
+	if (computation & 0x08) y = 0;
+	if (computation & 0x04) y = (uint16_t)~y;
+	uint16_t out = ((computation & 0x02) ? (uint16_t)(x + y) : (uint16_t)(x & y));
+	if (computation & 0x01) out = (uint16_t)~out;
+	return out;
+}
+/*
+	Functionality: Runs the program until it halts, runs past the end of the ROM or reaches the
+	               cycle limit.
+
+	How it does it: Keeps A, D and the program counter in locals. For each cycle:
+
+	1. Stops if the program counter is past the last word
+	2. Counts the cycle at its address. An A-instruction loads A
+	3. A C-instruction computes its output from D and from A or M, and stores it in M (at the
+	   address A had), D and A. Writing M at address 0 moves the stack pointer
+	4. Jumps to the address A had if the output meets the jump condition. An unconditional
+	   jump back to an A-instruction that loads its own address, right before the jump, loops
+	   forever without doing anything, so the program has halted
+*/
+void HackEmulator::run(uint64_t cycleLimit)
+{
+	uint16_t a = 0, d = 0;
+	size_t pc = 0;
+	size_t romSize = rom.size();
+	uint16_t* memory = ram.data();
+	uint64_t* counts = addressCycles.data();
+	uint64_t ran = 0;
+	int largest = largestStackPointer;
+
+	stopReason = STOP_CYCLE_LIMIT;
+	while (ran < cycleLimit)
 	{
-		int realIndex = 0;    // Takes into account that segments start at R3 or R5
-		if (m == "pointer") { m = "POINTER"; realIndex = 3 + i; }
-		else if (m == "temp") { m = "TEMP"; realIndex = 5 + i; }
-
-		if (c == "pop")
+		// 1.
+		if (pc >= romSize)
 		{
-			assemblyCode << "// POP " << m << " " << i << endl;
-			assemblyCode << "// Pop element from stack." << endl;
-			assemblyCode << "@SP" << endl;
-			assemblyCode << "AM=M-1" << endl;
-			assemblyCode << "D=M" << endl;
-			assemblyCode << "// Store it in temp register." << endl;
-			assemblyCode << "@R" << realIndex << endl;
-			assemblyCode << "M=D" << endl;
-
-			writtenInstructionsSoFar += 5;
-
+			stopReason = STOP_END_OF_ROM;
+			break;
 		}
-		else
-		{
-			assemblyCode << "// POP " << m << " " << i << endl;
-			assemblyCode << "// Store element in register." << endl;
-			assemblyCode << "@" << realIndex << endl;
-			assemblyCode << "D=M" << endl;
-			assemblyCode << "// Push it into the stack and update pointer." << endl;
-			assemblyCode << "@SP" << endl;
-			assemblyCode << "A=M" << endl;
-			assemblyCode << "M=D" << endl;
-			assemblyCode << "@SP" << endl;
-			assemblyCode << "M=M+1" << endl;
 
-			writtenInstructionsSoFar += 7;
+		// 2.
+		const DecodedWord& word = rom[pc];
+		counts[pc]++;
+		ran++;
+		if (word.isAInstruction)
+		{
+			a = word.value;
+			pc++;
+			continue;
 		}
-	}
-	else
-	{
-		if (c == "pop")
+
+		// 3.
+		uint16_t address = a;
+		uint16_t out = compute(word.computation, d, (word.computation & 0x40) ? memory[address] : address);
+		if (word.destination & 1)
 		{
-			assemblyCode << "// POP STATIC " << i << endl;
-			assemblyCode << "// Access last element in stack, stores it," << endl;
-			assemblyCode << "// and update pointer." << endl;
-			assemblyCode << "@SP" << endl;
-			assemblyCode << "AM=M-1" << endl;
-			assemblyCode << "D=M" << endl;
-			assemblyCode << "// Store element in correct static place." << endl;
-			assemblyCode << "@" << fileWOExtension << "." << i << endl;
-			assemblyCode << "M=D" << endl;
+			memory[address] = out;
+			if (address == 0 && (int16_t)out > largest) largest = (int16_t)out;
+		}
+		if (word.destination & 2) d = out;
+		if (word.destination & 4) a = out;
 
-			writtenInstructionsSoFar += 5;
+		// 4.
+		int16_t value = (int16_t)out;
+		bool jumps = ((word.jump & 4) && value < 0) || ((word.jump & 2) && value == 0) || ((word.jump & 1) && value > 0);
+		if (!jumps)
+		{
+			pc++;
+			continue;
 		}
-		else
+		bool programHalted = (word.jump == 7 && (size_t)address + 1 == pc && rom[address].isAInstruction && rom[address].value == address);
+		pc = address;
+		if (programHalted)
 		{
-			assemblyCode << "// PUSH STATIC " << i << endl;
-			assemblyCode << "// Access static element to push and store it." << endl;
-			assemblyCode << "@" << fileWOExtension << "." << i << endl;
-			assemblyCode << "D=M" << endl;
-			assemblyCode << "// Store in stack and update pointer." << endl;
-			assemblyCode << "@SP" << endl;
-			assemblyCode << "A=M" << endl;
-			assemblyCode << "M=D" << endl;
-			assemblyCode << "@SP" << endl;
-			assemblyCode << "M=M+1" << endl;
-
-			writtenInstructionsSoFar += 7;
+			stopReason = STOP_HALTED;
+			break;
 		}
 	}
+	cycles += ran;
+	largestStackPointer = largest;
 }
+
+// VMInterpreter class methods
 /*
-	What it does: Writes the needed preamble for every translated file. It sets up the stack
-				  pointer to 256, calls the sys.init() function of the operating system, and
-				  writes the code for the all the comparisons in the program.
+	Functionality: Decodes the instructions of every module of the program.
 
-	How it does it: 	1. Set up the stack pointer to 256
-						2. Sets up the Go to (sys.init)
-						3. Sets up the jump to avoid running the (TRUE) label on the first pass
-						4. Writes the (TRUE) label, which is used by all comparison instructions
+	How it does it:
+
+	1. Works out where every label and function ends up, since labels take no operation. A
+	   label belongs to the function it is in, and outside of any function to "main", like in
+	   the HACK code, and a name declared more than once keeps its first place
+	2. Decodes each instruction. A push or pop to a segment reached through a pointer keeps the
+	   pointer register and the index, and one to pointer, temp or static its RAM address. Each
+	   static gets the next address from 16 on the first time its file and index are seen
+	3. Resolves where every goto, if-goto and call goes. One that goes to a name nobody declares
+	   stops the program, and a goto to itself halts it
+	4. Ends the code with an operation that stops the program, and puts the bootstrap after it:
+	   a call to Sys.init with no arguments that returns to a halt
 */
-void CodeWriter::writeInit()
+VMInterpreter::VMInterpreter(const Program& program) : ram(ramWords, 0), entry(0), hasSysInit(false),
+	instructions(0), calls(0), stopReason(STOP_HALTED)
 {
-	int instructionsInPreamble = 14;
-	assemblyCode << "// Sets up the stack" << endl;
-	assemblyCode << "@256" << endl;
-	assemblyCode << "D=A" << endl;
-	assemblyCode << "@SP" << endl;
-	assemblyCode << "M=D" << endl;
-	assemblyCode << "// Calls Sys.init() " << endl;
-	assemblyCode << "@sys.init" << endl;
-	assemblyCode << "0;JMP" << endl;
-	assemblyCode << "// Makes sure the following is not executed on first pass." << endl;
-	assemblyCode << "// Jumps to the real first instruction of the program." << endl;
-	assemblyCode << "@" << instructionsInPreamble << endl;
-	assemblyCode << "0;JMP" << endl;
-	assemblyCode << "// Provides all the definitions for comparison instructions." << endl;
-	assemblyCode << "(TRUE)" << endl;
-	assemblyCode << "// Makes sure the value is placed in righ register" << endl;
-	assemblyCode << "@SP" << endl;
-	assemblyCode << "A=M-1" << endl;
-	assemblyCode << "M=-1" << endl;
-	assemblyCode << "// Holds the value of the instruction to which to jump" << endl;
-	assemblyCode << "// After label is finished running." << endl;
-	assemblyCode << "@R13" << endl;
-	assemblyCode << "A=M" << endl;
-	assemblyCode << "0;JMP" << endl;
-
-	writtenInstructionsSoFar += instructionsInPreamble;
-}
-/*
-	What it does: It handles the initializing of variables and writing of the bootstrap code
-				  The functionality depends on the number files that have been translated when
-				  it is called.
+	static_assert(RUN_NOT - RUN_ADD == OP_NOT - OP_ADD, "The arithmetic operations follow the arithmetic opcodes");
+	const vector<Instruction>& parsed = program.getInstructions();
+	auto labelKey = [](int function, int label) { return ((uint64_t)(uint32_t)function << 32) | (uint32_t)label; };
 
-	Assumptions: 1. This is only called when the driver is dealing with a folder with
-					multiple VM files.
-				 2. The file counter is never less than zero
+	// 1.
+	unordered_map<uint64_t, int> labels;
+	unordered_map<int, int> functions;
+	int operationCount = 0;
+	for (const Module& module : program.getModules())
+	{
+		int currentFunction = -1;
+		for (size_t i = module.firstInstruction; i < module.firstInstruction + module.instructionCount; i++)
+		{
+			const Instruction& instruction = parsed[i];
+			if (instruction.opcode == OP_FUNCTION) currentFunction = instruction.symbol;
+			if (instruction.opcode == OP_FUNCTION) functions.emplace(instruction.symbol, operationCount);
+			if (instruction.opcode == OP_LABEL) labels.emplace(labelKey(currentFunction, instruction.symbol), operationCount);
+			else if (instruction.opcode != OP_NONE) operationCount++;
+		}
+	}
 
-	Inputs:      1. A string containing the input file name
-				 2. An int that indicates how many files have been translated thus far.
+	// 2.
+	map<pair<string, int>, int> staticAddresses;
+	code.reserve(operationCount + 3);
+	for (const Module& module : program.getModules())
+	{
+		string fileWOExtension = withoutExtension(module.fileName);
+		int currentFunction = -1;
+		for (size_t i = module.firstInstruction; i < module.firstInstruction + module.instructionCount; i++)
+		{
+			const Instruction& instruction = parsed[i];
+			const SegmentInfo& segment = segmentTable[instruction.segment];
+			DecodedInstruction decoded = { RUN_END_OF_CODE, 0, (uint16_t)instruction.index, -1 };
+			bool pops = (instruction.opcode == OP_POP);
 
-	How it does it:  1. If file is first to be translated:
-	                 2.   Set the file without extension for static variable translation
-					 3.   Set the output file name
-					 4.   Open a connection to the output file
-					 5.   Initialize the written instruction counters to 0
-					 6.   Call the writeInit() function to write the preamble of the code
-					 7. If file is not the first file to be translated:
-					 8.   Set the file without extension for static variable translation
-					 9.   Set the output file name for completeness
+			if (instruction.opcode == OP_NONE || instruction.opcode == OP_LABEL) continue;
+			if (instruction.opcode >= OP_ADD && instruction.opcode <= OP_NOT)
+			{
+				decoded.operation = (Operation)(RUN_ADD + (instruction.opcode - OP_ADD));
+			}
+			else if ((instruction.opcode == OP_PUSH || pops) && segment.access == ACCESS_CONSTANT)
+			{
+				decoded.operation = RUN_PUSH_CONSTANT;    // writePushPop pushes a popped constant too
+			}
+			else if ((instruction.opcode == OP_PUSH || pops) && segment.access == ACCESS_THROUGH_POINTER)
+			{
+				decoded.operation = (pops ? RUN_POP_THROUGH_POINTER : RUN_PUSH_THROUGH_POINTER);
+				decoded.pointer = (uint8_t)hackSymbolValue(segment.baseLabel, strlen(segment.baseLabel));
+			}
+			else if ((instruction.opcode == OP_PUSH || pops) && segment.access == ACCESS_FIXED_REGISTER)
+			{
+				decoded.operation = (pops ? RUN_POP_REGISTER : RUN_PUSH_REGISTER);
+				decoded.value = (uint16_t)((segment.firstRegister + instruction.index) & (ramWords - 1));
+			}
+			else if (instruction.opcode == OP_PUSH || pops)
+			{
+				int nextStatic = 16 + (int)staticAddresses.size();
+				int address = staticAddresses.emplace(make_pair(fileWOExtension, instruction.index), nextStatic).first->second;
+				decoded.operation = (pops ? RUN_POP_REGISTER : RUN_PUSH_REGISTER);
+				decoded.value = (uint16_t)(address & (ramWords - 1));
+			}
+			else if (instruction.opcode == OP_FUNCTION)
+			{
+				currentFunction = instruction.symbol;
+				decoded.operation = RUN_FUNCTION;
+			}
+			else if (instruction.opcode == OP_RETURN)
+			{
+				decoded.operation = RUN_RETURN;
+			}
+			// 3.
+			else if (instruction.opcode == OP_CALL)
+			{
+				auto function = functions.find(instruction.symbol);
+				decoded.operation = (function == functions.end() ? RUN_UNDEFINED_SYMBOL : RUN_CALL);
+				if (function != functions.end()) decoded.target = function->second;
+			}
+			else
+			{
+				auto label = labels.find(labelKey(currentFunction, instruction.symbol));
+				decoded.operation = (instruction.opcode == OP_GOTO ? RUN_GOTO : RUN_IF_GOTO);
+				if (label != labels.end()) decoded.target = label->second;
+				if (label == labels.end()) decoded.operation = RUN_UNDEFINED_SYMBOL;
+				else if (decoded.operation == RUN_GOTO && decoded.target == (int)code.size()) decoded.operation = RUN_HALT;
+			}
+			code.push_back(decoded);
+		}
+	}
+
+	// 4.
+	code.push_back({ RUN_END_OF_CODE, 0, 0, -1 });
+	for (const pair<const int, int>& function : functions)
+	{
+		if (program.getSymbols().nameOf(function.first) != "Sys.init") continue;
+		hasSysInit = true;
+		entry = (int)code.size();
+		code.push_back({ RUN_CALL, 0, 0, function.second });
+		code.push_back({ RUN_HALT, 0, 0, -1 });
+	}
+}
+/*
+	Functionality: Runs the program until it stops.
+
+	How it does it: Sets the stack to start at 256 and keeps the stack pointer in a local, storing
+	                it in R0 once the program stops. Every other register is read and written in
+					RAM, and every address wraps around the 32K words of RAM.
+
+	1. Before each operation, stops if the limit of instructions has been reached, and otherwise
+	   jumps to the code of the operation. With computed gotos, the jump is at the end of the
+	   code of every operation, so the processor can predict each one on its own
+	2. Arithmetic works on the top of the stack. A comparison subtracts in 16 bits and tests the
+	   difference, like the HACK code, and is true as -1
+	3. A call pushes the return address, the low 16 bits of where it returns to, and LCL, ARG,
+	   THIS and THAT, then points ARG to its arguments and LCL to the top of the stack. Where
+	   it returns to is also kept whole, in a stack of its own, so code past the 64K words a
+	   RAM word can address still returns to the right place
+	4. A return puts the return value where ARG points, moves the stack right above it and
+	   restores THAT, THIS, ARG and LCL from the frame. A return nobody called halts
 */
-void CodeWriter::initialize(string inputFileName, int filesTranslatedSoFar)
+void VMInterpreter::run(uint64_t instructionLimit)
 {
-	if (filesTranslatedSoFar == 0)
+	uint16_t* memory = ram.data();
+	auto at = [memory](unsigned address) -> uint16_t& { return memory[address & (ramWords - 1)]; };
+	const DecodedInstruction* first = code.data();
+	const DecodedInstruction* ip = first + entry;
+	uint16_t sp = 256;
+	uint64_t remaining = instructionLimit;
+
+#if defined(__GNUC__)
+	static const void* const operationCode[] =
 	{
-		fileWOExtension = inputFileName.substr(0, inputFileName.find("."));
-		outputFileName = fileWOExtension + ".asm";
-		assemblyCode.open(outputFileName);
-		writtenInstructionsSoFar = 0;
-		functionTracker.push("main");
-		writeInit();
+		&&RUN_ADD_CODE, &&RUN_SUB_CODE, &&RUN_NEG_CODE, &&RUN_EQ_CODE, &&RUN_GT_CODE, &&RUN_LT_CODE,
+		&&RUN_AND_CODE, &&RUN_OR_CODE, &&RUN_NOT_CODE, &&RUN_PUSH_CONSTANT_CODE, &&RUN_PUSH_THROUGH_POINTER_CODE,
+		&&RUN_PUSH_REGISTER_CODE, &&RUN_POP_THROUGH_POINTER_CODE, &&RUN_POP_REGISTER_CODE, &&RUN_GOTO_CODE,
+		&&RUN_IF_GOTO_CODE, &&RUN_FUNCTION_CODE, &&RUN_CALL_CODE, &&RUN_RETURN_CODE, &&RUN_HALT_CODE,
+		&&RUN_END_OF_CODE_CODE, &&RUN_UNDEFINED_SYMBOL_CODE
+	};
+	static_assert(sizeof(operationCode) / sizeof(operationCode[0]) == RUN_UNDEFINED_SYMBOL + 1,
+		"operationCode needs one entry per Operation");
+#define OPERATION(operation) operation##_CODE:
+#define NEXT_OPERATION() do { if (remaining-- == 0) goto instructionLimitReached; goto *operationCode[ip->operation]; } while (false)
+#else
+#define OPERATION(operation) case operation:
+#define NEXT_OPERATION() goto dispatch
+#endif
+
+	// 1.
+	NEXT_OPERATION();
+#if !defined(__GNUC__)
+dispatch:
+	if (remaining-- == 0) goto instructionLimitReached;
+	switch (ip->operation)
+	{
+#endif
+	// 2.
+	OPERATION(RUN_ADD) { sp--; at(sp - 1) = (uint16_t)(at(sp - 1) + at(sp)); ip++; NEXT_OPERATION(); }
+	OPERATION(RUN_SUB) { sp--; at(sp - 1) = (uint16_t)(at(sp - 1) - at(sp)); ip++; NEXT_OPERATION(); }
+	OPERATION(RUN_NEG) { at(sp - 1) = (uint16_t)-at(sp - 1); ip++; NEXT_OPERATION(); }
+	OPERATION(RUN_EQ) { sp--; at(sp - 1) = (at(sp - 1) == at(sp) ? 0xFFFF : 0); ip++; NEXT_OPERATION(); }
+	OPERATION(RUN_GT) { sp--; at(sp - 1) = ((int16_t)(at(sp - 1) - at(sp)) > 0 ? 0xFFFF : 0); ip++; NEXT_OPERATION(); }
+	OPERATION(RUN_LT) { sp--; at(sp - 1) = ((int16_t)(at(sp - 1) - at(sp)) < 0 ? 0xFFFF : 0); ip++; NEXT_OPERATION(); }
+	OPERATION(RUN_AND) { sp--; at(sp - 1) &= at(sp); ip++; NEXT_OPERATION(); }
+	OPERATION(RUN_OR) { sp--; at(sp - 1) |= at(sp); ip++; NEXT_OPERATION(); }
+	OPERATION(RUN_NOT) { at(sp - 1) = (uint16_t)~at(sp - 1); ip++; NEXT_OPERATION(); }
+	OPERATION(RUN_PUSH_CONSTANT) { at(sp++) = ip->value; ip++; NEXT_OPERATION(); }
+	OPERATION(RUN_PUSH_THROUGH_POINTER) { at(sp++) = at(memory[ip->pointer] + ip->value); ip++; NEXT_OPERATION(); }
+	OPERATION(RUN_PUSH_REGISTER) { at(sp++) = memory[ip->value]; ip++; NEXT_OPERATION(); }
+	OPERATION(RUN_POP_THROUGH_POINTER) { at(memory[ip->pointer] + ip->value) = at(--sp); ip++; NEXT_OPERATION(); }
+	OPERATION(RUN_POP_REGISTER) { memory[ip->value] = at(--sp); ip++; NEXT_OPERATION(); }
+	OPERATION(RUN_GOTO) { ip = first + ip->target; NEXT_OPERATION(); }
+	OPERATION(RUN_IF_GOTO) { ip = (at(--sp) != 0 ? first + ip->target : ip + 1); NEXT_OPERATION(); }
+	OPERATION(RUN_FUNCTION)
+	{
+		for (int local = 0; local < ip->value; local++) at(sp++) = 0;
+		ip++;
+		NEXT_OPERATION();
 	}
-	else
+	// 3.
+	OPERATION(RUN_CALL)
 	{
-		fileWOExtension = inputFileName.substr(0, inputFileName.find("."));
-		outputFileName = fileWOExtension + ".asm";
+		int returnAddress = (int)(ip + 1 - first);
+		returnAddresses.push_back(returnAddress);
+		at(sp++) = (uint16_t)returnAddress;
+		for (int pointer = 1; pointer <= 4; pointer++) at(sp++) = memory[pointer];
+		memory[2] = (uint16_t)(sp - ip->value - 5);
+		memory[1] = sp;
+		calls++;
+		ip = first + ip->target;
+		NEXT_OPERATION();
+	}
+	// 4.
+	OPERATION(RUN_RETURN)
+	{
+		uint16_t frame = memory[1];
+		at(memory[2]) = at(--sp);
+		sp = (uint16_t)(memory[2] + 1);
+		for (int pointer = 4; pointer >= 1; pointer--) memory[pointer] = at(frame - 5 + pointer);
+		if (returnAddresses.empty())
+		{
+			stopReason = STOP_HALTED;
+			goto stopped;
+		}
+		ip = first + returnAddresses.back();
+		returnAddresses.pop_back();
+		NEXT_OPERATION();
 	}
+	OPERATION(RUN_HALT) { stopReason = STOP_HALTED; goto stopped; }
+	OPERATION(RUN_END_OF_CODE) { stopReason = STOP_END_OF_CODE; goto stopped; }
+	OPERATION(RUN_UNDEFINED_SYMBOL) { stopReason = STOP_UNDEFINED_SYMBOL; goto stopped; }
+#if !defined(__GNUC__)
+	}
+#endif
+#undef OPERATION
+#undef NEXT_OPERATION
+
+instructionLimitReached:
+	stopReason = STOP_INSTRUCTION_LIMIT;
+	remaining = 0;
+stopped:
+	memory[0] = sp;
+	instructions += instructionLimit - remaining;
 }
-/*
-	What it does: Writes HACK assembly code that effects the "label" command.
-
-	Assumptions:  1. Will not be called if there is no label command.
-				  2. The label is error free
-				  3. The stack tracking the called functions is not empty
-				  4. The input refers to a label that has not been used before inside the
-				     current function.
-
-	Inputs:       1. A string, l, containing the label to be output to the assembly file.
 
-	How it works: 1. Get the name of the labels scope from the function tracker stack.
-	              2. Construct the label to be output.
-				  3. Output the label to the assembly file.
-				  4. Update the written instruction count.
-*/
-void CodeWriter::writeLabel(string l)
+// FolderWatcher class methods
+FolderWatcher::FolderWatcher(const string& folder)
 {
-	string currFunction = functionTracker.top();
-	string label = "(" + currFunction + "$" + l + ")";
-	assemblyCode << "// LABEL " << l << " IN " << currFunction << endl;
-	assemblyCode << label << endl;
+	inotifyDescriptor = -1;
+#ifdef __linux__
+	inotifyDescriptor = inotify_init1(IN_CLOEXEC);
+	if (inotifyDescriptor >= 0) watchTree(folder);
+#else
+	(void)folder;
+#endif
 }
-/*
-	What it does: Writes HACK assembly code that effects the JACK VM "goto" command.
-	
-	Assumptions: 
-	1. The label is always within some function.
-	2. The passed label contains no mistakes.
-	3. The compiler takes care of returning to the correct instruction after the jump.
-					
-	Inputs: 
-	1. A string, l, containing the label to which to jump.
-
-	How it works: 
-	1. Gets the name of the function to which the label belongs.
-	2. Construct the label following language specifications.
-	3. Writes the assembly instructions.
-	4. Updates the written instructions counter.
-*/
-void CodeWriter::writeGOTO(string l)
+FolderWatcher::~FolderWatcher()
 {
-	string currFunct = functionTracker.top();
-	string label = currFunct + "$" + l;
-	assemblyCode << "// GO TO (" << label << ")" << endl;
-	assemblyCode << "@" << label << endl;
-	assemblyCode << "0;JMP" << endl;
-	writtenInstructionsSoFar += 2;
+#ifdef __linux__
+	if (inotifyDescriptor >= 0) close(inotifyDescriptor);
+#endif
 }
-/*
-	What it does: Writes HACK assembly code that effects the JACK VM if-goto command.
-
-	Assumptions:
-
-	  1. The label to which to jump is always inside a function.
-	  2. Label has not errors.
-	  3. The compiler translates where to jump if the jump is taken.
-
-	Inputs:
-	
-	  1. A string, l, containing the instruction to which to jump if the condition is met.
-
-	How it works:
-
-	  1. Get the name of the label's function
-	  2. Write the instructions to pop the stack and save the value
-	  3. Construct the label according to the language specs
-	  4. Write the assembly instructions to make the jump comparing the top of the stack to zero.
-	  5. Updates the written instruction count
-*/
-void CodeWriter::writeIf(string l)
+void FolderWatcher::watchTree(const string& folder)
 {
-	string currFunct = functionTracker.top();
-	assemblyCode << "// IF-GOTO " << l << " IN " << currFunct <<  endl;
-	assemblyCode << "// Pops stack and saves value." << endl;
-	assemblyCode << "@SP" << endl;
-	assemblyCode << "AM=M-1" << endl;
-	assemblyCode << "D=M" << endl;
-	assemblyCode << "// Compares result to zero and jumps if not equal." << endl;
-	assemblyCode << "// Continues execution if comparison is equal 0." << endl;
-
-	string label = currFunct + "$" + l;
-	assemblyCode << "@" << label << endl;
-	assemblyCode << "D;JNE" << endl;
-
-	writtenInstructionsSoFar += 5;
+#ifdef __linux__
+	const uint32_t events = IN_CREATE | IN_DELETE | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR;
+	int watchDescriptor = inotify_add_watch(inotifyDescriptor, folder.c_str(), events);
+	if (watchDescriptor < 0) return;
+	watchedFolders[watchDescriptor] = folder;
+
+	DIR* dirPointer = opendir(folder.c_str());
+	struct dirent* entry = nullptr;
+	while (dirPointer != nullptr && (entry = readdir(dirPointer)) != nullptr)
+	{
+		string entryPath = folder + "/" + entry->d_name;
+		struct stat entryStatus;
+		bool entryIsHidden = (entry->d_name[0] == '.');
+		bool entryIsFolder = (!entryIsHidden && lstat(entryPath.c_str(), &entryStatus) == 0 && S_ISDIR(entryStatus.st_mode));
+		if (entryIsFolder) watchTree(entryPath);
+	}
+	if (dirPointer != nullptr) closedir(dirPointer);
+#else
+	(void)folder;
+#endif
 }
 /*
-	What it does: Writes HACK assembly code that effects the JACK VM "call" command.
-
-	Assumptions:
-
-	Inputs:
-
-	    1. A string, fn, that contains the function name of the called function.
-		2. An int, na, that contains the number of arguments of the function.
+	Functionality: Returns once a VM file may have changed, been added or been removed.
 
-	How it works:
+	How it does it:
 
-	    1. Writes assembly to push the return-address to the stack
-		2. Writes assembly to push the LCL pointer to the stack
-		3. Writes assembly to push the ARG pointer to the stack
-		4. Writes assembly to push the THIS pointer to the stack
-		5. Writes assembly to push the THAT pointer to the stack
-		6. Writes assembly to reposition the ARG pointer to SP-#Args-5
-		7. Writes assembly to repostion the LCL pointer to the SP pointer
-		8. Writes assembly to go to the function label
-		9. Writes assembly to generate a label for the return address
+	1. Without inotify, sleeps for a quarter of a second
+	2. Otherwise, reads events until one is about a VM file or a folder, watching the folders
+	   that are created or moved in, and forgetting the ones that are gone
+	3. Then keeps reading events until there is none for 20 ms
 */
-void CodeWriter::writeCall(string fn, int na)
+void FolderWatcher::waitForChange()
 {
-	int HACKInstInCallCommand = 40;
-	int retAddress = writtenInstructionsSoFar + HACKInstInCallCommand;
-	int regToArg0FromStackPointer = na - 5;
-
-	assemblyCode << "// CALL " << fn << endl;
 	// 1.
-	assemblyCode << "// Pushes return address to stack" << endl;
-	assemblyCode << "// Stores value to be pushed." << endl;
-	assemblyCode << "@" << retAddress << endl;
-	assemblyCode << "D=A" << endl;
-	assemblyCode << "// Pushes value into the stack and updates pointers" << endl;
-	assemblyCode << "@SP" << endl;
-	assemblyCode << "A=M" << endl;
-	assemblyCode << "M=D" << endl;
-	assemblyCode << "@SP" << endl;
-	assemblyCode << "M=M+1" << endl;
-	// 2-5.
-	assemblyCode << "// Pushes the pointers LCL, THIS, THAT to stack" << endl;
-	for (int i = 1; i <= 4; i++)
-	{
-		assemblyCode << "// Stores value to be pushed." << endl;
-		assemblyCode << "@R" << i << endl;
-		assemblyCode << "D=M" << endl;
-		assemblyCode << "// Pushes value into the stack and updates pointers" << endl;
-		assemblyCode << "@SP" << endl;
-		assemblyCode << "A=M" << endl;
-		assemblyCode << "M=D" << endl;
-		assemblyCode << "@SP" << endl;
-		assemblyCode << "M=M+1" << endl;
+	if (!usesInotify())
+	{
+		this_thread::sleep_for(chrono::milliseconds(250));
+		return;
 	}
-	// 6.
-	assemblyCode << "// Repositions the arg pointer to arg 0." << endl;
-	assemblyCode << "@SP" << endl;
-	assemblyCode << "D=M" << endl;
-	assemblyCode << "@" << regToArg0FromStackPointer << endl;
-	assemblyCode << "D=M-A" << endl;
-	assemblyCode << "@ARG" << endl;
-	assemblyCode << "M=D" << endl;
-	// 7.
-	assemblyCode << "// Positions the LCL pointer to SP" << endl;
-	assemblyCode << "@SP" << endl;
-	assemblyCode << "D=M" << endl;
-	assemblyCode << "@LCL" << endl;
-	assemblyCode << "M=D" << endl;
-	// 8.
-	string currFunct = functionTracker.top();
-	string label = currFunct + "$" + fn;
-	assemblyCode << "// Go to function label" << "(" << label << ")" << endl;
-	assemblyCode << "@" << label << endl;
-	assemblyCode << "0;JMP" << endl;
-	// 9.
-	string retLabel = currFunct + "$" + fn + "RET";
-	assemblyCode << "// Label for return address" << endl;
-	assemblyCode << "(" << retLabel << ")" << endl;
+#ifdef __linux__
+	alignas(struct inotify_event) char events[1 << 16];
+	bool somethingChanged = false;
+	int timeout = -1;
+	while (true)
+	{
+		pollfd descriptor = { inotifyDescriptor, POLLIN, 0 };
+		int ready = poll(&descriptor, 1, timeout);
+		if (ready < 0 && errno == EINTR) continue;
+		if (ready <= 0) break;    // 3.
 
-	writtenInstructionsSoFar += HACKInstInCallCommand;
+		ssize_t length = read(inotifyDescriptor, events, sizeof(events));
+		for (ssize_t pos = 0; pos < length; )
+		{
+			// 2.
+			const struct inotify_event* event = (const struct inotify_event*)(events + pos);
+			pos += sizeof(struct inotify_event) + event->len;
+
+			bool folderIsGone = ((event->mask & IN_IGNORED) != 0);
+			if (folderIsGone) watchedFolders.erase(event->wd);
+			if (event->len == 0 || event->name[0] == '.') continue;
+
+			bool eventIsAboutFolder = ((event->mask & IN_ISDIR) != 0);
+			bool folderIsNew = (eventIsAboutFolder && (event->mask & (IN_CREATE | IN_MOVED_TO)) != 0);
+			auto folder = watchedFolders.find(event->wd);
+			if (folderIsNew && folder != watchedFolders.end()) watchTree(folder->second + "/" + event->name);
+			if (eventIsAboutFolder || fileIsVMFile(event->name)) somethingChanged = true;
+		}
+		if (somethingChanged) timeout = 20;
+	}
+#endif
 }
-/*
-	What it does: Writes the HACK assembly instructions that effect the "return" JACK VM command.
-
-	How it works:
 
-		(Write HACK Assembly that)
-	    1. Save the beginning of the callee's frame.
-		2. Save the return address.
-		3. Store the return value in ARG 0.
-		4. Reposition the Stack pointer.
-		5. Reposition the THAT pointer.
-		6. Reposition the THIS pointer.
-		7. Repostion the ARG pointer.
-		8. Reposition the LCL pointer.
-		9. Go to return address in the caller's code.
+// TranslationCache class methods
+/*
+	Functionality: Returns the 64-bit FNV-1a hash of the received bytes, continuing from the
+	               received hash.
 */
-void CodeWriter::writeReturn()
+uint64_t fnv1aHash(string_view bytes, uint64_t hash = 14695981039346656037ull)
 {
-	// 1. Saves the beginning of the callee's frame.
-	assemblyCode << "// RETURN" << endl;
-	assemblyCode << "// Sets LCL to frame temp variable." << endl;
-	assemblyCode << "@LCL" << endl;
-	assemblyCode << "D=M" << endl;
-	assemblyCode << "@R5" << endl;
-	assemblyCode << "M=D" << endl;
-	// 2. Saves the caller's return address
-	assemblyCode << "// Saves the caller's return address to temp variable." << endl;
-	assemblyCode << "@5" << endl;
-	assemblyCode << "D=A" << endl;
-	assemblyCode << "@R5" << endl;
-	assemblyCode << "A=M-D" << endl;
-	assemblyCode << "D=M" << endl;
-	assemblyCode << "@R6" << endl;
-	assemblyCode << "M=D" << endl;
-	// 3. Store function's return value in ARG 0 of caller.
-	assemblyCode << "// Saves the functions return value to the stack" << endl;
-	assemblyCode << "@SP" << endl;
-	assemblyCode << "AM=M-1" << endl;
-	assemblyCode << "D=M" << endl;
-	assemblyCode << "@ARG" << endl;
-	assemblyCode << "A=M" << endl;
-	assemblyCode << "M=D" << endl;
-	// 4. Repositions the stack pointer to follow caller's ARG0 + 1
-	assemblyCode << "// Repositions stack pointer" << endl;
-	assemblyCode << "@ARG" << endl;
-	assemblyCode << "D=M+1" << endl;
-	assemblyCode << "@SP" << endl;
-	assemblyCode << "M=D" << endl;
-	// 5-8. Writes HACK assembly that repositions the caller's pointers
-	assemblyCode << "// Repositions pointers in relation to frame's address" << endl;
-	assemblyCode << "@R5" << endl;
-	assemblyCode << "AM=M-1" << endl;
-	assemblyCode << "D=M" << endl;
-	assemblyCode << "@THAT" << endl;
-	assemblyCode << "M=D" << endl;
-	assemblyCode << "@R5" << endl;
-	assemblyCode << "AM=M-1" << endl;
-	assemblyCode << "D=M" << endl;
-	assemblyCode << "@THIS" << endl;
-	assemblyCode << "M=D" << endl;
-	assemblyCode << "@R5" << endl;
-	assemblyCode << "AM=M-1" << endl;
-	assemblyCode << "D=M" << endl;
-	assemblyCode << "@ARG" << endl;
-	assemblyCode << "M=D" << endl;
-	assemblyCode << "@R5" << endl;
-	assemblyCode << "AM=M-1" << endl;
-	assemblyCode << "D=M" << endl;
-	assemblyCode << "@LCL" << endl;
-	assemblyCode << "M=D" << endl;
-	// 6. Writes HACK code to jump to caller's return address
-	assemblyCode << "// Jumps to caller's return address" << endl;
-	assemblyCode << "@R6" << endl;
-	assemblyCode << "A=M" << endl;
-	assemblyCode << "0;JMP" << endl;
-
-	functionTracker.pop();    // Makes sure that labels from now on have the right function's name
-	writtenInstructionsSoFar += 44;
+	for (char byte : bytes)
+	{
+		hash ^= (unsigned char)byte;
+		hash *= 1099511628211ull;
+	}
+	return hash;
 }
 /*
-	What it does: Writes HACK assembly that effects the "function" JACK VM command.
-
-	Inputs:
-
-	    1. A string, fn, containing the name of the function
-		2. An int, nl, containing the number of local variables
-
-	How it works:
-		(Writes HACK)
-		0. Declare a label for the function entry
-	    1. Repeat nl times
-		2.    push 0
+	Functionality: Returns a hash of every HACK snippet, so translations made by a different
+	               code generator are never taken from the cache.
 */
-void CodeWriter::writeFunction(string fn, int nl)
-{
-	functionTracker.push(fn); // Makes sure that the labels have the curr. functs. name
-
-	// 0. Constructs and writes HACK that declares a label for the function entry
-	string functionLabel = "(" + fn + ")";
-	assemblyCode << functionLabel << endl;
-	// 1. Writes code to push 0 for all local variables
-	assemblyCode << "// Pushes 0 to " << nl << " local variables" << endl;
-	assemblyCode << "// Uses temp registers R5 and R6 to hold index and target" << endl;
-	assemblyCode << "@R5" << endl;
-	assemblyCode << "M=0" << endl;
-	assemblyCode << "@" << nl << endl;
-	assemblyCode << "D=A" << endl;
-	assemblyCode << "@R6" << endl;
-	assemblyCode << "M=D" << endl;
-	assemblyCode << "// Enters a loop to push 0 into the stack" << endl;
-	assemblyCode << "(LOOP_0)" << endl;
-	assemblyCode << "// If i - " << nl << " >= 0" << endl;
-	assemblyCode << "@R5" << endl;
-	assemblyCode << "D=M" << endl;
-	assemblyCode << "@R6" << endl;
-	assemblyCode << "D=D-M" << endl;
-	assemblyCode << "@END_LOOP_0" << endl;
-	assemblyCode << "D;JGE" << endl;
-	assemblyCode << "// Pushes 0 to stack and updates i" << endl;
-	assemblyCode << "@SP" << endl;
-	assemblyCode << "A=M" << endl;
-	assemblyCode << "M=0" << endl;
-	assemblyCode << "@SP" << endl;
-	assemblyCode << "M=M+1" << endl;
-	assemblyCode << "@R5" << endl;
-	assemblyCode << "M=M+1" << endl;
-	assemblyCode << "// Jumps to LOOP_0" << endl;
-	assemblyCode << "@LOOP_0" << endl;
-	assemblyCode << "0;JMP" << endl;
-	assemblyCode << "(END_LOOP_0)" << endl;
-
-	writtenInstructionsSoFar += 21;
-}
\ No newline at end of file
+uint64_t codeGeneratorHash()
+{
+	static const Snippet* const snippets[] = {
+		&comparisonSnippet, &addSnippet, &subSnippet, &negSnippet, &andSnippet, &orSnippet,
+		&notSnippet, &pushConstantSnippet, &popThroughPointerSnippet, &pushThroughPointerSnippet,
+		&popFixedRegisterSnippet, &pushFixedRegisterSnippet, &popStaticSnippet, &pushStaticSnippet,
+		&initSnippet, &labelSnippet, &gotoSnippet, &ifSnippet, &callSnippet, &returnSnippet,
+		&functionSnippet, &functionLoopSnippet };
+	uint64_t hash = fnv1aHash("HACK snippets 3");
+	for (const Snippet* snippet : snippets) hash = fnv1aHash(string_view(snippet->text, snippet->length), hash);
+	return hash;
+}
+TranslationCache::TranslationCache(string folderName)
+	: folder(folderName)
+{
+#ifdef _WIN32
+	_mkdir(folder.c_str());
+#else
+	mkdir(folder.c_str(), 0777);
+#endif
+}
+string TranslationCache::entryPath(uint64_t key) const
+{
+	char name[17];
+	snprintf(name, sizeof(name), "%016llx", (unsigned long long)key);
+	return folder + "/" + name + ".vmo";
+}
+uint64_t TranslationCache::keyOf(string_view vmCode, const string& moduleName, bool toMachineCode)
+{
+	static const uint64_t generatorHash = codeGeneratorHash();
+	uint64_t hash = fnv1aHash(vmCode, generatorHash);
+	hash = fnv1aHash(string_view("\0", 1), hash);
+	hash = fnv1aHash(moduleName, hash);
+	hash = fnv1aHash(string_view("\0", 1), hash);
+	return fnv1aHash(toMachineCode ? "machine code" : "assembly", hash);
+}
+bool TranslationCache::load(uint64_t key, ObjectModule& object) const
+{
+	return loadObject(entryPath(key), object);
+}
+void TranslationCache::store(uint64_t key, const ObjectModule& object) const
+{
+	saveObject(entryPath(key), object);
+}